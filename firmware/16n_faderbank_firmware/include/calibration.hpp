@@ -0,0 +1,28 @@
+#pragma once
+#include "filter.hpp"
+
+/*
+ * On-device calibration: while it runs, move every fader to both of its ends.
+ * The smallest and largest readings each fader reaches become its limits.
+ */
+namespace calibration {
+void Start();
+
+/*
+ * Takes note of the smoothed readings from a scan frame
+ */
+void Track(const FilterBank& filters);
+
+/*
+ * Stores the limits that were found and starts using them.
+ * Faders that didn't move far enough keep their previous calibration.
+ */
+void Finish();
+
+/*
+ * Forgets every fader's own limits, going back to the global fadermin/max
+ */
+void Clear();
+
+bool active();
+}  // namespace calibration
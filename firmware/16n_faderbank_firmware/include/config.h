@@ -33,9 +33,14 @@ constexpr int DEVICE_ID = 0x02;  // 16n, do not change, needed by editor
 // enables legacy compatibility with non-multiplexer boards
 // #define V125
 
-// define startup delay in milliseconds for i2c Leader devices
-// this gives follower devices time to boot up.
-constexpr int BOOTDELAY = 10000;
+// sends MIDI as soon as a fader changes, rather than polling for changes every 1ms
+// #define MIDI_IMMEDIATE 1
+
+// streams every raw ADC frame over USB serial, for capturing traces to replay on the host
+// #define TRACE_ADC 1
+
+// counts cycles spent in the main loop, scan, MIDI and i2c, readable over SysEx
+// #define PROFILING 1
 
 // I2C Address for Faderbank. 0x34 unless you ABSOLUTELY know what you are doing.
 constexpr uint8_t I2C_ADDRESS = 0x34;
@@ -58,3 +63,15 @@ constexpr int kNumChannels = 16;
 #ifndef V125
 #define V125 0
 #endif
+
+#ifndef MIDI_IMMEDIATE
+#define MIDI_IMMEDIATE 0
+#endif
+
+#ifndef PROFILING
+#define PROFILING 0
+#endif
+
+#ifndef TRACE_ADC
+#define TRACE_ADC 0
+#endif
@@ -1,7 +1,10 @@
 #pragma once
+#include <algorithm>
 #include <array>
+#include <bitset>
 #include <cstddef>
 #include <cstdint>
+#include <span>
 #include "config.h"
 
 struct Config {
@@ -23,22 +26,134 @@ struct Config {
 
     MIDI_THRU = 8,  // bool
 
+    // HIGH RESOLUTION OUTPUT
+    HIRES_MODE = 9,       // bits 0-1 USB, bits 2-3 TRS, see Resolution
+    HIRES_DEADBAND = 10,  // uint8_t, in 14-bit steps
+    HIRES_FADERS = 11,    // 5x 7-bit mask, bits 0-15 USB faders, bits 16-31 TRS faders
+
     MIDI_USB_CHANNEL = 16,  // 16x uint8_t
     MIDI_TRS_CHANNEL = 32,  // 16x uint8_t
     MIDI_USB_CC = 48,       // 16x uint8_t
     MIDI_TRS_CC = 64,       // 16x uint8_t
+
+    // INPUT FILTER
+    FILTER_MODE = 80,        // see FilterMode
+    FILTER_MIN_CUTOFF = 81,  // adaptive cutoff at rest, in 0.1Hz
+    FILTER_BETA = 82,        // adaptive cutoff rise with speed, in 0.1Hz per count/ms
+
+    // IDLE
+    IDLE_TIMEOUT = 83,  // seconds with no fader moving before the scan slows down, 0 for never
+
+    // PER-FADER CALIBRATION
+    CALIBRATION = 96,  // 16x fadermin lsb/msb, fadermax lsb/msb
+
+    // PRESETS
+    PRESET_CHANNEL = 160,   // MIDI channel Program Change switches presets on, 0 for none
+    PRESET_SNAPSHOT = 161,  // bool, send every fader under the new mapping after switching
+    PRESET_ACTIVE = 162,    // the mapping in use: 0 for the one above, 1-8 for a preset slot
+    PRESETS = 176,          // 8x preset slot, see PRESET_SIZE
+
+    // EXTRA ROUTES
+    ROUTES = 688,  // 16x route, see ROUTE_SIZE
+
+    // MIDI THRU
+    THRU_USB_TO_TRS = 784,  // the kinds of message passed from USB to TRS, see thru::Kind
+    THRU_TRS_TO_USB = 785,  // and from TRS to USB
   };
   constexpr static size_t DEVICE_CONFIG_SIZE = MIDI_USB_CHANNEL;  // the size of a device config block
   constexpr static size_t MIDI_CONFIG_SIZE = 16;                  // the size of a midi config block
-  constexpr static size_t SIZE = MIDI_TRS_CC + 16;
+  constexpr static size_t FILTER_CONFIG_SIZE = 16;                // the size of the filter config block
+  constexpr static size_t CALIBRATION_SIZE = 4 * kNumChannels;    // the size of the calibration block
+  constexpr static size_t PRESET_CONFIG_SIZE = 16;                // the size of the preset config block
+  constexpr static size_t PRESET_SIZE = 4 * kNumChannels;         // the size of one preset slot
+  constexpr static size_t NUM_PRESETS = 8;
+  constexpr static size_t ROUTE_SIZE = 6;  // the size of one extra route
+  constexpr static size_t NUM_ROUTES = 16;
+  constexpr static size_t THRU_CONFIG_SIZE = 16;  // the size of the thru config block
+  constexpr static size_t SIZE = THRU_USB_TO_TRS + THRU_CONFIG_SIZE;
+  constexpr static size_t HIRES_FADERS_SIZE = 5;
+
+  /// How a fader's value is encoded on a port
+  enum class Resolution : uint8_t {
+    CC_7BIT = 0,   // a single CC, the top 7 bits
+    CC_14BIT = 1,  // MSB on CC n, LSB on CC n+32 (only for CCs 0-31)
+    NRPN = 2,      // NRPN n with a 14-bit data entry
+  };
+
+  /// How the raw fader readings are smoothed
+  enum class FilterMode : uint8_t {
+    RESPONSIVE = 0,  // ResponsiveAnalogRead style: snap to big moves, sleep through small ones
+    ADAPTIVE = 1,    // one-euro style: the cutoff follows the fader's speed
+  };
+
+  /// Maps a fader's raw readings onto 0-16383 with a multiply and shift
+  struct Calibration {
+    uint16_t min;
+    uint16_t max;
+    uint32_t scale;  // Q.16, 16383 / (max - min)
+
+    uint16_t Map(uint16_t raw) const {
+      return ((std::clamp(raw, min, max) - min) * scale) >> 16;
+    }
+  };
+
+  /// Where a fader's value can go
+  enum class Port : uint8_t {
+    NONE = 0,
+    USB = 1,
+    TRS = 2,
+    I2C = 3,
+  };
+
+  /// One place a fader's value goes
+  struct Destination {
+    Port port;
+    Resolution resolution;  // MIDI only
+    uint8_t channel;        // MIDI channel, or the follower's i2c address
+    uint8_t number;         // CC or NRPN number, or the i2c command
+    uint8_t output;         // the follower's output, i2c only
+    uint8_t low;            // the value sent at each end of the fader, in 7-bit steps.
+    uint8_t high;           // low above high turns the fader upside down
+    uint8_t device = 0;     // the follower's place in i2c's table, found when the routes are compiled
+
+    int Scale(int value) const {
+      return low * 129 + (high - low) * 129 * value / 16383;
+    }
+  };
+
+  /// Every fader's destinations in one flat table: fader c's run from first[c] up to first[c + 1]
+  template <size_t N>
+  struct Routes {
+    std::array<Destination, N> destinations;
+    std::array<uint8_t, kNumChannels + 1> first;
+  };
 
-  // MIDI Channel to send each fader data on
-  std::array<uint8_t, kNumChannels> usb_channels;
-  std::array<uint8_t, kNumChannels> trs_channels;
+  // A preset's routes: each fader's USB, then TRS output
+  using Mapping = Routes<2 * kNumChannels>;
 
-  // CC codes to send for each fader
-  std::array<uint8_t, kNumChannels> usb_ccs;
-  std::array<uint8_t, kNumChannels> trs_ccs;
+  // Routes that don't change with the preset: each fader's extra routes, then its i2c followers
+  constexpr static size_t SHARED_ROUTES = NUM_ROUTES + 3 * kNumChannels;
+  using SharedRoutes = Routes<SHARED_ROUTES>;
+
+  // Destinations are numbered across both tables, the mapping's first
+  constexpr static size_t FIRST_SHARED = 2 * kNumChannels;
+  constexpr static size_t NUM_DESTINATIONS = FIRST_SHARED + SHARED_ROUTES;
+
+  // Every mapping, ready to use: the config's own, then each preset slot
+  std::array<Mapping, 1 + NUM_PRESETS> mappings;
+
+  // The mapping the outputs use. Switching preset only moves this.
+  const Mapping* mapping = &mappings[0];
+
+  SharedRoutes routes;
+
+  const Destination& destination(size_t d) const {
+    return d < FIRST_SHARED ? mapping->destinations[d] : routes.destinations[d - FIRST_SHARED];
+  }
+
+  // Program Change channel for switching presets, 0 for none
+  uint8_t preset_channel;
+  bool preset_snapshot;
 
   std::array<uint8_t, kNumChannels> legacy_ports;  // for V125 only
 
@@ -48,14 +163,84 @@ struct Config {
   bool i2c_master;
   bool midi_thru;
 
+  // The kinds of message passed through in each direction, see thru::Kind
+  uint8_t thru_usb_to_trs;
+  uint8_t thru_trs_to_usb;
+
   // Fader limits
   uint16_t fader_min;
   uint16_t fader_max;
 
+  // Each fader's own limits, or the ones above if it hasn't been calibrated
+  std::array<Calibration, kNumChannels> calibrations;
+
+  // How far a high resolution value has to move before it is sent again
+  uint8_t hires_deadband;
+
+  // Input filter
+  FilterMode filter_mode;
+  uint8_t filter_min_cutoff;
+  uint8_t filter_beta;
+
+  // Seconds with no fader moving before going idle, 0 for never
+  uint8_t idle_timeout;
+
+  // The config block as it is in EEPROM, or will be once the edits to it are committed
+  using Image = std::array<uint8_t, SIZE>;
+  Image image;
+
  public:
+  /*
+   * Reads the newest of the two config blocks in EEPROM that passes its header and CRC checks.
+   * Blocks written by older firmware are moved to the current layout; if neither block passes,
+   * or they were never initialised, the config is reset to factory settings.
+   */
   void Check();
+
+  /*
+   * Puts the factory settings in the config block. Like any edit, they reach EEPROM later.
+   */
   void FactoryReset();
+
+  /*
+   * Works out the settings from the config block
+   */
   void Load();
+
+  /*
+   * Stores the config's own mapping in a preset slot, 1-8
+   */
+  void StorePreset(size_t preset);
+
+  /*
+   * Changes part of the config block, taking effect on the next Load().
+   * Only the bytes that differ are marked for writing, nothing is written to EEPROM here.
+   */
+  void Edit(int address, std::span<const uint8_t> data);
+
+  /*
+   * Writes a changed byte to the EEPROM slot not in use, once the config has been left alone for a moment.
+   * Called from the main loop, so an emulated EEPROM write never holds up a config push or MIDI.
+   */
+  void Commit();
+
+  /*
+   * Are there edits that haven't reached EEPROM yet?
+   */
+  bool dirty() const {
+    return unsaved_;
+  }
+
+ private:
+  void Set(int address, uint8_t value);
+
+  std::bitset<SIZE> dirty_;  // bytes of the image that differ from the slot being written
+  bool unsaved_ = false;     // the image differs from the slot in use
+  bool committing_ = false;  // the other slot is being written
+  size_t active_ = 1;        // the slot the config came from or was last written to
+  uint8_t sequence_ = 0;     // that slot's sequence number, the next one written gets one more
+  size_t next_commit_ = 0;   // where Commit() looks for the next changed byte
+  uint32_t edited_at_ = 0;
 };
 
 extern Config config;
@@ -0,0 +1,82 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include "config.h"
+#include "configuration.hpp"
+#include "scan.hpp"
+
+/*
+ * Smooths every fader channel in one pass, in integer arithmetic.
+ *
+ * The responsive mode is ResponsiveAnalogRead's algorithm, with sleep and edge snap enabled,
+ * using fixed point state so none of it needs soft-float on the Teensy 3.2.
+ *
+ * The adaptive mode is a one-euro filter: a low pass whose cutoff rises with the fader's speed,
+ * so fast throws track closely and a resting fader is smoothed down to near DC.
+ *
+ * State is kept per field across all the channels rather than per channel.
+ */
+class FilterBank {
+ public:
+  using Values = std::array<uint16_t, kNumChannels>;
+
+  /*
+   * resolution: the number of distinct raw values (1 << ADC bits)
+   * activity_threshold: how far the error has to move before a sleeping channel wakes up
+   * snap_multiplier: how quickly the output snaps to the input, as in ResponsiveAnalogRead
+   */
+  void Setup(int resolution, int activity_threshold, float snap_multiplier);
+
+  /*
+   * Picks up the filter mode and adaptive parameters from the config
+   */
+  void Configure(const Config& config);
+
+  /*
+   * Sets how often frames arrive, in us, so the adaptive filter's cutoffs stay where they were set
+   * when the scan slows down
+   */
+  void SetFrameInterval(uint32_t frame_interval);
+
+  /*
+   * Runs a frame of raw samples through the filters.
+   * Returns a bitmask of the channels whose output changed.
+   */
+  uint16_t Update(const Values& raw);
+
+  uint16_t value(size_t channel) const {
+    return values_[channel];
+  }
+
+ private:
+  uint16_t UpdateResponsive(const Values& raw);
+  uint16_t UpdateAdaptive(const Values& raw);
+
+  /*
+   * Works out the adaptive filter's smoothing factors for the parameters and the frame interval
+   */
+  void Design();
+
+  std::array<int32_t, kNumChannels> smooth_;  // Q16.16
+  std::array<int32_t, kNumChannels> error_;   // Q.8, moving average of the input - output error
+  std::array<int32_t, kNumChannels> speed_;   // Q16.16 counts per frame, smoothed
+  Values last_raw_;                           // the last frame's input, for the speed
+  Values values_;
+
+  Config::FilterMode mode_ = Config::FilterMode::RESPONSIVE;
+
+  int32_t resolution_;
+  int32_t activity_threshold_;
+  uint32_t snap_divisor_;  // 1 / snap multiplier
+
+  float min_cutoff_ = 1.0f;  // Hz
+  float beta_per_ms_ = 0.0f;  // Hz per count/ms
+  uint32_t frame_interval_ = scan::frame_interval;
+
+  int32_t min_rate_;     // Q.16 2 pi cutoff interval, at rest
+  int32_t beta_;         // Q.16 2 pi cutoff interval, added per count/frame of speed
+  int32_t speed_alpha_;  // Q.16 smoothing factor for the speed estimate
+};
+
+extern FilterBank filters;
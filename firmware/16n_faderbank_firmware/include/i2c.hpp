@@ -11,27 +11,60 @@ constexpr int er301 = 0x31;
 constexpr int txo = 0x60;
 }  // namespace addresses
 
+// every follower address we send to
+constexpr size_t num_devices = 9;
+
+// what a leader can ask of us as a follower, as the first byte of a write of two bytes or more
+namespace commands {
+constexpr uint8_t read_all = 0x10;      // the next read is every fader
+constexpr uint8_t read_range = 0x11;    // the next read is the 16-bit value's count of faders, from the output's
+constexpr uint8_t read_changed = 0x12;  // the next read is a mask of the faders changed since the last one, then those
+}  // namespace commands
+
 void Setup();
 
 /*
- * Sends an i2c command out to a slave when running in master mode
+ * Finds a follower by its address, num_devices if it isn't one we send to
+ */
+size_t FindDevice(uint8_t address);
+
+/*
+ * Sets the value to send to an i2c destination when running in master mode,
+ * by its place in the shared routes. Only the newest value is kept, it goes out from Service().
+ */
+void Queue(size_t route, uint16_t value);
+
+/*
+ * Moves the non-blocking transmit queue along: finishes the transfer in flight and starts the next.
+ * Followers that fail to answer are backed off rather than retried every time.
+ *
+ * Also probes for missing followers every second, so they can be plugged in at any time.
+ * A follower that appears gets every fader's current value.
+ */
+void Service();
+
+/*
+ * Makes the faders' current values the ones a leader reads when we're a follower.
+ * Called once the values from a complete scan are in, so a read never mixes two scans.
+ * Never masks interrupts, the follower callbacks read a copy this doesn't touch.
  */
-void Send(uint8_t model, uint8_t deviceIndex, uint8_t cmd, uint8_t devicePort, uint16_t value);
+void Publish();
 
 /*
  * The function that responds to a command from i2c.
- * In the first version, this simply sets the port to be read from.
+ * A single byte sets the port to be read from, anything longer is a command.
  */
 void Write(size_t len);
 
 /*
  * The function that responds to read requests over i2c.
- * This uses the port from the write request to determine which slider to send.
+ * This answers with the faders the last write asked for, from the last complete scan.
  */
 void ReadRequest();
 
 /*
- * Future function if we add more i2c capabilities beyond reading values.
+ * Sets up a bulk read: the next read answers with every fader, a range of them,
+ * or the ones that have changed since the last read of changes
  */
 void actOnCommand(uint8_t cmd, uint8_t out, int value);
 }  // namespace i2c
@@ -4,14 +4,82 @@
 namespace MIDI {
 constexpr static int interval = 1000;  // 1ms
 
+/*
+ * The most bytes a controller message can take at the given resolution
+ */
+constexpr int MessageSize(Config::Resolution resolution) {
+  switch (resolution) {
+    case Config::Resolution::CC_14BIT:
+      return 6;
+    case Config::Resolution::NRPN:
+      return 12;
+    default:
+      return 3;
+  }
+}
+
+/*
+ * Sends a 14-bit fader value as a controller message at the given resolution
+ */
+template <typename Interface>
+void SendControl(Interface& port, Config::Resolution resolution, uint8_t cc, int value, uint8_t channel) {
+  const uint8_t msb = value >> 7;
+  const uint8_t lsb = value & 0x7F;
+
+  switch (resolution) {
+    case Config::Resolution::CC_14BIT:
+      // only CCs 0-31 have an LSB partner, anything else falls back to 7-bit
+      if (cc < 32) {
+        port.sendControlChange(cc, msb, channel);
+        port.sendControlChange(cc + 32, lsb, channel);
+        return;
+      }
+      break;
+
+    case Config::Resolution::NRPN:
+      port.sendControlChange(99, 0, channel);    // NRPN MSB
+      port.sendControlChange(98, cc, channel);   // NRPN LSB
+      port.sendControlChange(6, msb, channel);   // data entry MSB
+      port.sendControlChange(38, lsb, channel);  // data entry LSB
+      return;
+
+    case Config::Resolution::CC_7BIT:
+      break;
+  }
+
+  port.sendControlChange(cc, msb, channel);
+}
+
 constexpr uint32_t flash_duration = 50;
-extern uint32_t last_activity_at;
 
 void Setup();
 void Start();
+
+/*
+ * Reads whatever MIDI has arrived on either port. Run every interval.
+ */
 void Read();
+
+/*
+ * Sends the faders that have changed since the last write, every interval.
+ * With MIDI_IMMEDIATE they've already gone, and this only sends forced updates.
+ */
 void Write();
 
+/*
+ * Called when a fader's value changes.
+ * With MIDI_IMMEDIATE this sends it straight away instead of on the next write tick.
+ */
+void Changed(size_t channel);
+
+/*
+ * With MIDI_IMMEDIATE, pushes any buffered USB messages out now rather than when the USB buffer fills
+ */
+void Flush();
+
+/*
+ * Has MIDI gone out since this was last asked?
+ */
 bool get_and_clear_activity();
 void force_write();
 };  // namespace MIDI
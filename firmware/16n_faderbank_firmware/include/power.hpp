@@ -0,0 +1,49 @@
+#pragma once
+#include <cstdint>
+#include "scan.hpp"
+
+/*
+ * Idle mode. Once no fader has moved for the configured timeout, the scan slows down and the CPU sleeps
+ * between interrupts: the scan's timer and ADC, USB, the UART, i2c, or the 1ms tick. The first frame
+ * that shows a fader moving brings the full scan rate back, and the filters are told how often frames come.
+ */
+namespace power {
+// how far a raw sample has to move from the last frame's to wake us while idle, in counts.
+// The filters' activity threshold, clear of the noise between two frames.
+constexpr int wake_threshold = 32;
+
+// rough current draw of a Teensy 3.2 at 96MHz with USB up, awake and asleep, in uA.
+// Only used for the average reported over SysEx; measure a unit to correct them.
+constexpr uint32_t run_current = 40000;
+constexpr uint32_t sleep_current = 22000;
+
+/// What idling has saved, since boot or since they were last reset
+struct Stats {
+  uint32_t idles = 0;                  // times the scan slowed down
+  uint32_t idle_time = 0;              // ms spent idle
+  uint32_t sleep_time = 0;             // ms spent asleep, waiting for an interrupt
+  uint32_t total_time = 0;             // ms these cover
+  uint32_t worst_wake_latency = 0;     // us from a frame completing while idle to it being picked up
+  uint32_t average_wake_latency = 0;   // us
+  uint32_t average_current = 0;        // uA, estimated from the time awake and asleep
+};
+
+/*
+ * Called with each frame, and whether the filters saw any fader move in it.
+ * While idle, a raw sample that jumps from the last frame's counts as moving too.
+ */
+void Update(const scan::Frame& frame, bool active);
+
+/*
+ * Waits for the next interrupt when idle, and returns straight away otherwise.
+ * Called at the end of each pass through the main loop.
+ */
+void Sleep();
+
+bool idle();
+
+/*
+ * Copies out the stats, and optionally starts them over
+ */
+void Read(Stats& stats, bool reset);
+}  // namespace power
@@ -0,0 +1,31 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+/*
+ * Preset slots: each holds a whole mapping of channels, CCs and resolutions for both MIDI ports.
+ * Mapping 0 is the config's own, the one the editor changes; 1-8 are the preset slots.
+ */
+namespace presets {
+/*
+ * Switches the outputs to a mapping. Every mapping is worked out in advance, so this is immediate.
+ * With the preset snapshot option on, every fader is sent again under the new mapping.
+ */
+void Recall(size_t preset);
+
+/*
+ * Stores the config's own mapping in a preset slot, 1-8
+ */
+void Store(size_t preset);
+
+/*
+ * Replaces a preset slot, 1-8, with a slot's worth of bytes, as laid out in the config block
+ */
+void Write(size_t preset, std::span<const uint8_t> data);
+
+/*
+ * Recalls a preset when a Program Change arrives on the preset channel
+ */
+void ProgramChange(uint8_t channel, uint8_t program);
+}  // namespace presets
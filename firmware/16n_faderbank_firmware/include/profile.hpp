@@ -0,0 +1,71 @@
+#pragma once
+#include <Arduino.h>
+#include <array>
+#include <cstdint>
+#include "config.h"
+
+/*
+ * Cycle counts for the firmware's busy paths, from the Cortex-M4's DWT cycle counter.
+ * Everything here compiles away unless PROFILING is set in config.h.
+ */
+namespace profile {
+enum Section : uint8_t {
+  LOOP,        // a whole pass through loop()
+  SCAN_ISR,    // one ADC conversion complete interrupt
+  CHANNELS,    // filtering, mapping and queueing a complete frame
+  MIDI_READ,   // MIDI::Read()
+  MIDI_WRITE,  // MIDI::WriteInternal()
+  I2C,         // i2c::Service()
+  NUM_SECTIONS,
+};
+
+// upper edges of the histogram buckets in microseconds, the last bucket takes anything longer
+constexpr std::array<uint32_t, 7> bucket_edges = {5, 10, 20, 50, 100, 200, 500};
+
+struct Stats {
+  uint32_t count = 0;
+  uint32_t min = UINT32_MAX;
+  uint32_t max = 0;
+  uint64_t total = 0;
+  std::array<uint32_t, bucket_edges.size() + 1> histogram{};
+};
+
+/*
+ * Turns on the cycle counter
+ */
+void Setup();
+
+void Record(Section section, uint32_t cycles);
+
+/*
+ * Counts a scheduled task that started after its deadline
+ */
+void Overrun();
+
+/*
+ * Copies out the stats for every section, and optionally starts them over
+ */
+void Read(std::array<Stats, NUM_SECTIONS>& stats, uint32_t& overruns, bool reset);
+
+/*
+ * Times from construction to the end of the enclosing scope
+ */
+class Scope {
+ public:
+  explicit Scope(Section section) : section_(section) {
+    if constexpr (PROFILING) {
+      started_ = ARM_DWT_CYCCNT;
+    }
+  }
+
+  ~Scope() {
+    if constexpr (PROFILING) {
+      Record(section_, ARM_DWT_CYCCNT - started_);
+    }
+  }
+
+ private:
+  Section section_;
+  uint32_t started_ = 0;
+};
+}  // namespace profile
@@ -0,0 +1,47 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include "config.h"
+
+namespace scan {
+/// One raw ADC sample per fader, indexed by fader (rotation already applied)
+using Frame = std::array<uint16_t, kNumChannels>;
+
+constexpr int resolution = 13;  // 13 bit ADC resolution on Teensy 3.2
+
+// time given to each channel: the mux settles and then the ADC converts.
+// must be longer than the conversion time plus the 10us mux settle time.
+constexpr int step_interval = 50;  // 50us, i.e. a full frame every 800us
+
+constexpr int frame_interval = step_interval * kNumChannels;
+
+// the step when idle, i.e. a full frame every 10ms
+constexpr int idle_step_interval = 625;
+
+constexpr int idle_frame_interval = idle_step_interval * kNumChannels;
+
+void Setup();
+
+/*
+ * Starts the background scan. From here on the mux is stepped and the ADC
+ * triggered from a timer and the conversion complete interrupt.
+ */
+void Start();
+
+/*
+ * Slows the scan down to idle_step_interval, or brings it back to full speed.
+ * Takes effect from the next step.
+ */
+void SetIdle(bool idle);
+
+/*
+ * Copies the most recently completed frame into `frame`.
+ * Returns false if no new frame has completed since the last call.
+ */
+bool Read(Frame& frame);
+
+/*
+ * The micros() at which the frame last copied by Read() was completed
+ */
+uint32_t frame_time();
+}  // namespace scan
@@ -0,0 +1,59 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * A small cooperative scheduler for the main loop, with a fixed number of tasks.
+ * Tasks run to completion, so nothing is preempted: each pass runs every task that is due once,
+ * highest priority first, and within a priority the one whose deadline is nearest.
+ * A task's deadline is how long after it's due it should have started by; every later start is a miss.
+ */
+namespace scheduler {
+constexpr size_t max_tasks = 12;
+
+// not LOW and HIGH, which Arduino already has
+enum Priority : uint8_t {
+  BACKGROUND,
+  NORMAL,
+  URGENT,
+};
+
+using Task = uint8_t;
+using Function = void (*)();
+
+/// How well a task has kept to its deadline
+struct Stats {
+  uint32_t runs = 0;
+  uint32_t misses = 0;          // runs that started after their deadline
+  uint32_t worst_lateness = 0;  // the longest a run started after it was due, in us
+};
+
+/*
+ * Adds a task that runs every period us, or on every pass with a period of 0.
+ * A task that runs on every pass is due again as soon as it has run, so its lateness is the gap between runs.
+ */
+Task Every(uint32_t period, Priority priority, uint32_t deadline, Function function);
+
+/*
+ * Adds a task that only runs once it has been armed, and then only once
+ */
+Task Once(Priority priority, uint32_t deadline, Function function);
+
+/*
+ * Arms a one-shot task to run in delay us, replacing any earlier arming.
+ * From the main loop only, not from interrupts.
+ */
+void Arm(Task task, uint32_t delay);
+
+/*
+ * Runs each task that's due, once, most urgent first
+ */
+void Run();
+
+/*
+ * Copies out each task's stats, in the order the tasks were added, and optionally starts them over.
+ * Returns the number of tasks.
+ */
+size_t Read(std::array<Stats, max_tasks>& stats, bool reset);
+}  // namespace scheduler
@@ -9,15 +9,8 @@ struct State {
   // the current value of the faders
   std::array<int, kNumChannels> current;
 
-  // memory of the last unshifted value
-  std::array<int, kNumChannels> last;
-
-  struct Message {
-    bool should_send = false;
-    uint32_t send_at = 0;
-  };
-
-  Message forced_control_update{};
+  // the last raw samples from the scan, in output order
+  std::array<uint16_t, kNumChannels> raw;
 };
 
 extern State state;
@@ -4,17 +4,26 @@
 
 namespace sysex {
 enum class InboundMessageType {
+  EDIT_CONFIG_FILTER = 0x0A,  // 0A - c0nfig filter edit - new config just for the input filter
   EDIT_CONFIG_TRS = 0x0B,     // 0B - c0nfig trs edit - here is a new config just for trs
   EDIT_CONFIG_USB = 0x0C,     // 0C - c0nfig usb edit - here is a new config just for usb
   EDIT_CONFIG_DEVICE = 0x0D,  // 0D - c0nfig Device edit - new config just for device opts
   EDIT_CONFIG = 0x0E,         // 0E - c0nfig Edit - here is a new config
+  REQUEST_STATS = 0x15,       // 15 - "1 Stats" - please send me your telemetry counters
+  REQUEST_STATE = 0x16,       // 16 - "1 State" - please send me your fader values, now or every so often
+  REQUEST_PROFILE = 0x17,     // 17 - "1 Profile" - please send me your cycle counts
   INITIALIZE = 0x1A,          // 1A - 1nitiAlize - blank EEPROM and reset to factory settings.
+  PRESET = 0x1B,              // 1B - 1 Bank - recall, store or write a preset slot
+  CALIBRATE = 0x1C,           // 1C - 1 Calibrate - start, finish or clear per-fader calibration
   REQUEST_INFO = 0x1F,        // 1F = "1nFo" - please send me your current config
 };
 
 struct OutboundMessageType {
   enum {
-    CONFIG = 0x0F,  // 0F - "c0nFig" - outputs its config:
+    STATS = 0x05,    // 05 - "Stats" - outputs its telemetry counters
+    STATE = 0x06,    // 06 - "State" - outputs its fader values
+    PROFILE = 0x07,  // 07 - "Profile" - outputs its cycle counts
+    CONFIG = 0x0F,   // 0F - "c0nFig" - outputs its config:
   };
 };
 
@@ -24,5 +33,19 @@ struct Layout {
   };
 };
 
-void Parse(uint8_t* sysexData, size_t size);
+/*
+ * Acts on a whole SysEx message, F0 to F7, if it's for us and the right size for its type
+ */
+void Parse(std::span<const uint8_t> message);
+
+/*
+ * Takes SysEx from usbMIDI a chunk at a time, as long messages arrive, putting ours back together to act on
+ * once the last chunk is in. Someone else's is passed on through thru as it arrives, as soon as its header shows it.
+ */
+void Receive(const uint8_t* data, uint16_t length, bool complete);
+
+/*
+ * Sends the fader values again when they've been asked for every so often
+ */
+void Service();
 }  // namespace sysex
@@ -0,0 +1,44 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include "i2c.hpp"
+
+/// Counters for what the 16n has been doing since boot, or since they were last reset
+struct Telemetry {
+  uint32_t usb_messages = 0;      // controller messages sent over USB
+  uint32_t trs_messages = 0;      // controller messages sent over TRS
+  uint32_t suppressed = 0;        // 7-bit messages step hysteresis saved, that never went out, across both ports
+  uint32_t trs_coalesced = 0;     // TRS values replaced by a newer one before they went out
+  uint32_t i2c_coalesced = 0;     // i2c values replaced by a newer one before they went out
+  uint32_t trs_stalls = 0;        // times a TRS message had to wait for room in Serial1
+  uint32_t sysex_parsed = 0;      // SysEx messages for us that we acted on
+  uint32_t sysex_rejected = 0;     // SysEx messages that were unfinished, not for us, unknown or the wrong size
+  uint32_t loops_per_second = 0;   // passes through loop() in the last full second
+  uint32_t thru_dropped = 0;       // thru messages with no room to go out, or SysEx too long to pass on
+
+  /// Transfers to one i2c follower address
+  struct Follower {
+    uint8_t address = 0;
+    uint32_t transfers = 0;
+    uint32_t naks = 0;
+    uint32_t timeouts = 0;
+  };
+
+  std::array<Follower, i2c::num_devices> followers;
+
+  /*
+   * Counts a pass through loop(), and updates loops_per_second once a second
+   */
+  void CountLoop();
+
+  /*
+   * Sets every counter back to zero
+   */
+  void Reset();
+
+ private:
+  uint32_t loops_ = 0;
+  uint32_t second_started_at_ = 0;
+};
+
+extern Telemetry telemetry;
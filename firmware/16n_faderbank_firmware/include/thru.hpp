@@ -0,0 +1,88 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+/*
+ * MIDI thru between the USB and TRS ports, in both directions.
+ * Messages are passed on as bytes, without going through a MIDI library's decode and re-encode.
+ */
+namespace thru {
+/// The kinds of message a direction lets through, one bit each
+enum Kind : uint8_t {
+  CHANNEL = 1 << 0,   // notes, controllers, program changes, pressure and pitch bend
+  SYSEX = 1 << 1,     // system exclusive
+  COMMON = 1 << 2,    // time code, song position, song select and tune request
+  CLOCK = 1 << 3,     // clock, start, continue and stop
+  REALTIME = 1 << 4,  // active sensing and reset
+};
+
+// what went from USB to TRS before the filters: everything but SysEx, and real time even with thru off
+constexpr uint8_t default_filter = CHANNEL | COMMON | CLOCK | REALTIME;
+constexpr uint8_t realtime_filter = CLOCK | REALTIME;
+
+/*
+ * How many bytes a message starting with this status byte takes, status included.
+ * 0 for SysEx, which runs until its end byte.
+ */
+constexpr size_t MessageLength(uint8_t status) {
+  switch (status & 0xF0) {
+    case 0xC0:  // program change
+    case 0xD0:  // channel pressure
+      return 2;
+    case 0xF0:
+      break;
+    default:
+      return 3;
+  }
+
+  switch (status) {
+    case 0xF0:
+      return 0;
+    case 0xF1:  // time code quarter frame
+    case 0xF3:  // song select
+      return 2;
+    case 0xF2:  // song position
+      return 3;
+    default:
+      return 1;
+  }
+}
+
+/*
+ * Which kind of message a status byte starts
+ */
+constexpr Kind KindOf(uint8_t status) {
+  if (status < 0xF0) {
+    return CHANNEL;
+  }
+  if (status == 0xF0) {
+    return SYSEX;
+  }
+  if (status < 0xF8) {
+    return COMMON;
+  }
+  if (status == 0xF8 || (status >= 0xFA && status <= 0xFC)) {
+    return CLOCK;
+  }
+  return REALTIME;
+}
+
+/*
+ * Passes a piece of a SysEx message from USB on to TRS, if the filter lets it through, as it arrives.
+ * A piece starting with F0 starts a message, and one ending with F7 ends it.
+ * A message TRS has no room for is dropped from there on, and counted in telemetry.
+ */
+void ForwardSysEx(std::span<const uint8_t> piece);
+
+/*
+ * Ends a SysEx message from USB that stopped before its F7, so TRS isn't left in the middle of it
+ */
+void EndSysEx();
+
+/*
+ * Reads everything waiting on both ports, passing on what each direction's filter lets through.
+ * Program Changes switch presets whichever port they arrive on, through or not.
+ */
+void Read();
+}  // namespace thru
@@ -0,0 +1,41 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+/*
+ * The TRS MIDI output: fader values and thru messages merged into one stream of bytes.
+ * Messages are never split by another, except by real time bytes, which MIDI allows anywhere.
+ * Thru messages and fader values take turns, a message at a time.
+ */
+namespace trs {
+void Start();
+
+/*
+ * Sets the value to send to a TRS destination, by its number in the routing tables,
+ * replacing any value still waiting to go out.
+ */
+void Queue(size_t destination, int value);
+
+/*
+ * How many bytes of thru Forward() can take
+ */
+size_t Room();
+
+/*
+ * Queues a message to pass through, status byte first: a whole one, or a piece of a SysEx message.
+ * Dropped and counted in telemetry if there isn't room for all of it.
+ */
+void Forward(std::span<const uint8_t> message);
+
+/*
+ * Queues a real time byte to pass through, ahead of everything else
+ */
+void ForwardRealTime(uint8_t type);
+
+/*
+ * Sends whatever is waiting for as long as Serial1 has room: real time first, then thru messages and
+ * fader values in turn, the faders round robin. Never blocks: whatever doesn't fit waits for the next call.
+ */
+void Service();
+}  // namespace trs
@@ -18,8 +18,6 @@ std::array<uint8_t, size> read(int offset = 0) {
   }
   return buffer;
 }
-
-void write(std::span<uint8_t> buffer, int position = 0);
 }  // namespace eeprom
 
 namespace debug {
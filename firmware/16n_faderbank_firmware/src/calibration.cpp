@@ -0,0 +1,79 @@
+/*
+ * 16n Faderbank per-fader calibration
+ * MIT License
+ */
+#include "calibration.hpp"
+
+#include <algorithm>
+#include <array>
+#include "configuration.hpp"
+
+static bool active_ = false;
+
+// the readings seen so far, by physical fader
+static std::array<uint16_t, kNumChannels> lowest;
+static std::array<uint16_t, kNumChannels> highest;
+
+// a little inside the extremes, so the ends can be reached every time
+constexpr uint16_t margin = 8;
+
+// less than this and the fader wasn't moved, keep what it had
+constexpr uint16_t min_range = 512;
+
+namespace calibration {
+
+void Start() {
+  DEBUG_PRINTLN("Calibration started");
+  lowest.fill(UINT16_MAX);
+  highest.fill(0);
+  active_ = true;
+}
+
+void Track(const FilterBank& filters) {
+  for (int i = 0; i < kNumChannels; i++) {
+    const int fader = config.rotate ? kNumChannels - i - 1 : i;
+    lowest[fader] = std::min(lowest[fader], filters.value(i));
+    highest[fader] = std::max(highest[fader], filters.value(i));
+  }
+}
+
+void Finish() {
+  if (!active_) {
+    return;
+  }
+  active_ = false;
+
+  for (int fader = 0; fader < kNumChannels; fader++) {
+    if (highest[fader] < lowest[fader] + min_range) {
+      DEBUG_PRINTF("Fader %d didn't move, keeping its calibration\n", fader);
+      continue;
+    }
+
+    const uint16_t min = lowest[fader] + margin;
+    const uint16_t max = highest[fader] - margin;
+    std::array<uint8_t, 4> buffer = {
+        static_cast<uint8_t>(min & 0x7F),
+        static_cast<uint8_t>(min >> 7),
+        static_cast<uint8_t>(max & 0x7F),
+        static_cast<uint8_t>(max >> 7),
+    };
+    config.Edit(Config::CALIBRATION + 4 * fader, buffer);
+
+    DEBUG_PRINTF("Fader %d calibrated to %d-%d\n", fader, min, max);
+  }
+
+  config.Load();
+}
+
+void Clear() {
+  active_ = false;
+
+  std::array<uint8_t, Config::CALIBRATION_SIZE> blank{};
+  config.Edit(Config::CALIBRATION, blank);
+  config.Load();
+}
+
+bool active() {
+  return active_;
+}
+}  // namespace calibration
@@ -7,101 +7,580 @@
 #include <Arduino.h>
 #include <EEPROM.h>
 #include <array>
+#include "i2c.hpp"
+#include "thru.hpp"
 #include "utils.hpp"
 
 constexpr std::array default_ccs = {32, 33, 34, 35, 36, 37, 38, 39, 40, 41, 42, 43, 44, 45, 46, 47};
 
-void Config::Check() {
-  // if byte1 of EEPROM is FF for whatever reason, let's assume the machine needs initializing
-  int firstByte = EEPROM.read(0x00);
+// adaptive filter defaults: 1Hz at rest, rising 1.2Hz per count/ms
+constexpr uint8_t default_filter_min_cutoff = 10;
+constexpr uint8_t default_filter_beta = 12;
 
-  if (firstByte > 0x01) {
-    DEBUG_PRINTLN("First Byte is > 0x01, probably needs initialising");
-    FactoryReset();
-    return;
+// a fader whose calibration covers less than this is treated as uncalibrated
+constexpr uint16_t min_calibration_range = 256;
+
+// how long the config has to be left alone before edits are written out
+constexpr uint32_t commit_delay = 500;  // 500ms
+
+// the header in front of the config block in EEPROM
+constexpr std::array<uint8_t, 2> magic = {0x16, 'n'};
+constexpr uint8_t layout_version = 5;
+constexpr size_t header_size = 8;  // magic, version, sequence, length lsb/msb, CRC lsb/msb
+
+// EEPROM holds two copies of the config, each a header and a block. Commits go to the one that isn't in use,
+// so if the power goes halfway through, the last good copy is still there.
+constexpr size_t num_slots = 2;
+
+/*
+ * CRC-16/CCITT of the bytes in the config block that are stored
+ */
+uint16_t Crc(std::span<const uint8_t> data) {
+  uint16_t crc = 0xFFFF;
+  for (uint8_t byte : data) {
+    crc ^= byte << 8;
+    for (int bit = 0; bit < 8; bit++) {
+      crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
   }
+  return crc;
+}
 
-  DEBUG_PRINTF("First Byte is set to: %02X\n", firstByte);
-  std::array buffer = eeprom::read<Config::SIZE>();
+/*
+ * How much of the config block fits in a slot after the header.
+ * All of it on a Teensy 3.2, the Teensy LC's 128 bytes only take the start.
+ */
+size_t StoredSize() {
+  return std::min<size_t>(Config::SIZE, EEPROM.length() / num_slots - header_size);
+}
 
-  DEBUG_PRINTLN("Config found:");
-  debug::printArray(buffer);
+/*
+ * Where a slot starts in EEPROM
+ */
+int SlotAddress(size_t slot) {
+  return slot * (header_size + StoredSize());
 }
 
-void Config::FactoryReset() {
+// where each field of a preset slot starts, with channel and resolution packed into one byte per fader
+constexpr size_t preset_usb_outputs = 0;   // 16x channel - 1 in bits 0-3, resolution in bits 4-5
+constexpr size_t preset_trs_outputs = 16;  // 16x as above
+constexpr size_t preset_usb_ccs = 32;      // 16x uint8_t
+constexpr size_t preset_trs_ccs = 48;      // 16x uint8_t
+
+// the size of the config block before the header was added
+constexpr size_t v0_size = 160;
+
+// where each field of an extra route is
+constexpr size_t route_target = 0;   // fader in bits 0-3, port in bits 4-5
+constexpr size_t route_channel = 1;  // MIDI channel - 1 in bits 0-3, resolution in bits 4-5; or i2c address
+constexpr size_t route_number = 2;   // CC or NRPN number, or i2c command
+constexpr size_t route_output = 3;   // i2c output
+constexpr size_t route_low = 4;      // the value sent at the bottom of the fader, in 7-bit steps
+constexpr size_t route_high = 5;     // and at the top
+
+/*
+ * Adds a destination for the next fader to a routing table
+ */
+template <size_t N>
+void AddDestination(Config::Routes<N>& routes, size_t& size, const Config::Destination& destination) {
+  if (size < N) {
+    routes.destinations[size++] = destination;
+  }
+}
+
+/*
+ * The resolution a destination actually sends at, from the 2 bits stored for it.
+ * A 14-bit CC needs an LSB partner, which only CCs 0-31 have, so above that it's 7-bit,
+ * and so is the unused value 3. Change detection goes by this too.
+ */
+Config::Resolution ResolutionFor(uint8_t bits, uint8_t cc) {
+  const auto resolution = static_cast<Config::Resolution>(bits & 0x03);
+  switch (resolution) {
+    case Config::Resolution::CC_14BIT:
+      return cc < 32 ? resolution : Config::Resolution::CC_7BIT;
+    case Config::Resolution::NRPN:
+      return resolution;
+    default:
+      return Config::Resolution::CC_7BIT;
+  }
+}
+
+/*
+ * A MIDI destination covering the whole range
+ */
+Config::Destination MidiDestination(Config::Port port, uint8_t channel, uint8_t cc, uint8_t resolution) {
+  return {port, ResolutionFor(resolution, cc), channel, cc, 0, 0, 127};
+}
+
+/*
+ * An i2c destination covering the whole range, on a follower we send to
+ */
+Config::Destination I2CDestination(uint8_t address, uint8_t command, uint8_t output) {
+  return {Config::Port::I2C, {}, address, command, output, 0, 127, uint8_t(i2c::FindDevice(address))};
+}
+
+/*
+ * Works out the mapping from the config's own channel, CC and high resolution settings
+ */
+Config::Mapping CompileMapping(const Config::Image& image) {
+  // output resolution, the port's high resolution mode applies to the faders set in its mask
+  int hires_mode = image[Config::HIRES_MODE];
+  const uint8_t usb_hires = hires_mode & 0x03;
+  const uint8_t trs_hires = (hires_mode >> 2) & 0x03;
+
+  uint64_t hires_faders = 0;
+  for (size_t i = 0; i < Config::HIRES_FADERS_SIZE; i++) {
+    hires_faders |= static_cast<uint64_t>(image[Config::HIRES_FADERS + i] & 0x7F) << (7 * i);
+  }
+
+  Config::Mapping mapping;
+  size_t size = 0;
+  for (int i = 0; i < kNumChannels; i++) {
+    mapping.first[i] = size;
+    AddDestination(mapping, size,
+                   MidiDestination(Config::Port::USB, image[Config::MIDI_USB_CHANNEL + i], image[Config::MIDI_USB_CC + i],
+                                   (hires_faders >> i) & 1 ? usb_hires : 0));
+    AddDestination(mapping, size,
+                   MidiDestination(Config::Port::TRS, image[Config::MIDI_TRS_CHANNEL + i], image[Config::MIDI_TRS_CC + i],
+                                   (hires_faders >> (kNumChannels + i)) & 1 ? trs_hires : 0));
+  }
+  mapping.first[kNumChannels] = size;
+  return mapping;
+}
+
+/*
+ * Works out the mapping stored in a preset slot, 1-8
+ */
+Config::Mapping CompilePreset(const Config::Image& image, size_t preset) {
+  const uint8_t* slot = &image[Config::PRESETS + (preset - 1) * Config::PRESET_SIZE];
+
+  Config::Mapping mapping;
+  size_t size = 0;
+  for (int i = 0; i < kNumChannels; i++) {
+    mapping.first[i] = size;
+    AddDestination(mapping, size,
+                   MidiDestination(Config::Port::USB, (slot[preset_usb_outputs + i] & 0x0F) + 1,
+                                   slot[preset_usb_ccs + i], slot[preset_usb_outputs + i] >> 4));
+    AddDestination(mapping, size,
+                   MidiDestination(Config::Port::TRS, (slot[preset_trs_outputs + i] & 0x0F) + 1,
+                                   slot[preset_trs_ccs + i], slot[preset_trs_outputs + i] >> 4));
+  }
+  mapping.first[kNumChannels] = size;
+  return mapping;
+}
+
+/*
+ * Works out the routes every mapping shares: the extra routes, and as an i2c leader,
+ * each fader's output on every follower
+ */
+Config::SharedRoutes CompileRoutes(const Config::Image& image, bool i2c_master) {
+  Config::SharedRoutes routes;
+  size_t size = 0;
+  for (uint8_t fader = 0; fader < kNumChannels; fader++) {
+    routes.first[fader] = size;
+
+    for (size_t r = 0; r < Config::NUM_ROUTES; r++) {
+      const uint8_t* route = &image[Config::ROUTES + r * Config::ROUTE_SIZE];
+      const auto port = static_cast<Config::Port>((route[route_target] >> 4) & 0x03);
+      if (port == Config::Port::NONE || (route[route_target] & 0x0F) != fader) {
+        continue;
+      }
+
+      if (port == Config::Port::I2C) {
+        // a follower we don't send to would only be looked for, and never found, on every move
+        const size_t device = i2c::FindDevice(route[route_channel]);
+        if (device == i2c::num_devices) {
+          continue;
+        }
+        AddDestination(routes, size,
+                       {port, Config::Resolution::CC_7BIT, route[route_channel], route[route_number],
+                        route[route_output], route[route_low], route[route_high], uint8_t(device)});
+      }
+      else {
+        Config::Destination destination = MidiDestination(port, (route[route_channel] & 0x0F) + 1,
+                                                          route[route_number], route[route_channel] >> 4);
+        destination.low = route[route_low];
+        destination.high = route[route_high];
+        AddDestination(routes, size, destination);
+      }
+    }
+
+    if (i2c_master) {
+      // TXo and Ansible take four faders on each device, the ER-301 takes all sixteen
+      const uint8_t port = fader % 4;
+      const uint8_t device = fader / 4;
+      AddDestination(routes, size, I2CDestination(i2c::addresses::txo + device, 0x11, port));
+      AddDestination(routes, size, I2CDestination(i2c::addresses::er301, 0x11, fader));
+      AddDestination(routes, size, I2CDestination(i2c::addresses::ansible + 2 * device, 0x06, port));
+    }
+  }
+  routes.first[kNumChannels] = size;
+  return routes;
+}
+
+/*
+ * Lays a mapping out as the bytes of a preset slot
+ */
+std::array<uint8_t, Config::PRESET_SIZE> EncodePreset(const Config::Mapping& mapping) {
+  std::array<uint8_t, Config::PRESET_SIZE> slot;
+  for (int i = 0; i < kNumChannels; i++) {
+    const auto& usb = mapping.destinations[mapping.first[i]];
+    const auto& trs = mapping.destinations[mapping.first[i] + 1];
+    slot[preset_usb_outputs + i] = ((usb.channel - 1) & 0x0F) | (static_cast<uint8_t>(usb.resolution) << 4);
+    slot[preset_trs_outputs + i] = ((trs.channel - 1) & 0x0F) | (static_cast<uint8_t>(trs.resolution) << 4);
+    slot[preset_usb_ccs + i] = usb.number;
+    slot[preset_trs_ccs + i] = trs.number;
+  }
+  return slot;
+}
+
+/*
+ * Fills every preset slot with the config's own mapping
+ */
+void FillPresets(Config::Image& image) {
+  const auto slot = EncodePreset(CompileMapping(image));
+  for (size_t preset = 0; preset < Config::NUM_PRESETS; preset++) {
+    std::copy(slot.begin(), slot.end(), image.begin() + Config::PRESETS + preset * Config::PRESET_SIZE);
+  }
+}
+
+/*
+ * The factory settings for the whole config block
+ */
+Config::Image Defaults() {
+  Config::Image defaults{};
+
   // set default config flags (LED POWER, LED DATA, ROTATE, etc)
   // fadermin/max are based on "works for me" for twra2. Your mileage may vary.
-  EEPROM.write(Config::LED_POWER, 1);      // LED POWER
-  EEPROM.write(Config::LED_DATA, 1);       // LED DATA
-  EEPROM.write(Config::ROTATE, 0);         // ROTATE
-  EEPROM.write(Config::I2C_MASTER, 0);     // I2C follower by default
-  EEPROM.write(Config::FADERMIN_LSB, 15);  // fadermin LSB
-  EEPROM.write(Config::FADERMIN_MSB, 0);   // fadermin MSB
-  EEPROM.write(Config::FADERMAX_LSB, 71);  // fadermax LSB
-  EEPROM.write(Config::FADERMAX_MSB, 63);  // fadermax MSB
-  EEPROM.write(Config::MIDI_THRU, 0);      // Soft midi thru
+  defaults[Config::LED_POWER] = 1;      // LED POWER
+  defaults[Config::LED_DATA] = 1;       // LED DATA
+  defaults[Config::ROTATE] = 0;         // ROTATE
+  defaults[Config::I2C_MASTER] = 0;     // I2C follower by default
+  defaults[Config::FADERMIN_LSB] = 15;  // fadermin LSB
+  defaults[Config::FADERMIN_MSB] = 0;   // fadermin MSB
+  defaults[Config::FADERMAX_LSB] = 71;  // fadermax LSB
+  defaults[Config::FADERMAX_MSB] = 63;  // fadermax MSB
+  defaults[Config::MIDI_THRU] = 0;      // Soft midi thru
 
-  // blank remaining config slots.
-  for (size_t i = Config::MIDI_THRU; i < Config::DEVICE_CONFIG_SIZE; i++) {
-    EEPROM.write(i, 0);
-  }
+  // remaining config slots are blank, 7-bit output everywhere,
+  // but set a sensible deadband for when high resolution gets enabled
+  defaults[Config::HIRES_DEADBAND] = 8;
 
   // set default MIDI values
   for (int i = 0; i < kNumChannels; i++) {
     // All sliders to Midi CH 1
-    EEPROM.write(Config::MIDI_USB_CHANNEL + i, 1);
-    EEPROM.write(Config::MIDI_TRS_CHANNEL + i, 1);
+    defaults[Config::MIDI_USB_CHANNEL + i] = 1;
+    defaults[Config::MIDI_TRS_CHANNEL + i] = 1;
 
     // Use default CC values
-    EEPROM.write(Config::MIDI_USB_CC + i, default_ccs[i]);
-    EEPROM.write(Config::MIDI_TRS_CC + i, default_ccs[i]);
+    defaults[Config::MIDI_USB_CC + i] = default_ccs[i];
+    defaults[Config::MIDI_TRS_CC + i] = default_ccs[i];
   }
 
+  // set default filter config
+  defaults[Config::FILTER_MIN_CUTOFF] = default_filter_min_cutoff;
+  defaults[Config::FILTER_BETA] = default_filter_beta;
+
+  // no per-fader calibration, use fadermin/max for all of them
+
+  // thru passes on what it always has, once it's turned on
+  defaults[Config::THRU_USB_TO_TRS] = thru::default_filter;
+
+  // no Program Change switching, and every preset the same as the config
+  FillPresets(defaults);
+
+  return defaults;
+}
+
+/*
+ * Layout 0 is the config block on its own at the start of EEPROM, as firmware before the header wrote it.
+ * The filter and calibration blocks were added to it over time, so they may never have been written:
+ * anything that isn't a 7-bit value is set to its default.
+ */
+void MigrateFromV0(Config::Image& image) {
+  const Config::Image defaults = Defaults();
+  for (size_t i = 0; i < image.size(); i++) {
+    if (image[i] > 0x7F) {
+      image[i] = defaults[i];
+    }
+  }
+}
+
+/*
+ * Layout 2 adds preset slots. They start out as copies of the mapping the 16n already had,
+ * so switching to one changes nothing until it's been stored.
+ */
+void MigrateFromV1(Config::Image& image) {
+  FillPresets(image);
+}
+
+/*
+ * Layout 3 adds the extra routes, which come from the defaults unused, so there's nothing to move
+ */
+void MigrateFromV2(Config::Image&) {
+}
+
+/*
+ * Layout 4 adds the thru filters, whose defaults let through what thru always did
+ */
+void MigrateFromV3(Config::Image&) {
+}
+
+/*
+ * Layout 5 adds the idle timeout, which comes from the blank byte off, so there's nothing to move
+ */
+void MigrateFromV4(Config::Image&) {
+}
+
+// migrations[n] takes a config block from layout n to layout n + 1
+constexpr std::array<void (*)(Config::Image&), layout_version> migrations = {
+    MigrateFromV0, MigrateFromV1, MigrateFromV2, MigrateFromV3, MigrateFromV4};
+
+void Config::Set(int address, uint8_t value) {
+  if (image[address] != value) {
+    image[address] = value;
+    unsaved_ = true;
+
+    // a commit under way writes it too, it may have gone past this byte or found it the same
+    if (committing_) {
+      dirty_.set(address);
+    }
+  }
+}
+
+void Config::Edit(int address, std::span<const uint8_t> data) {
+  for (size_t i = 0; i < data.size() && address + i < SIZE; i++) {
+    Set(address + i, data[i]);
+  }
+  edited_at_ = millis();
+}
+
+void Config::Commit() {
+  if (!unsaved_ || millis() - edited_at_ < commit_delay) {
+    return;
+  }
+
+  const int address = SlotAddress(active_ ^ 1);
+
+  // first mark the slot unfinished, so it can't be loaded half written, and find what differs in it
+  if (!committing_) {
+    EEPROM.update(address, 0xFF);
+    for (size_t i = 0; i < SIZE; i++) {
+      dirty_[i] = i < StoredSize() && EEPROM.read(address + header_size + i) != image[i];
+    }
+    committing_ = true;
+    return;
+  }
+
+  // then one byte per call, each emulated EEPROM write stalls the CPU. Set() marks edits on the way.
+  if (dirty_.any()) {
+    while (!dirty_.test(next_commit_)) {
+      next_commit_ = (next_commit_ + 1) % SIZE;
+    }
+    if (next_commit_ < StoredSize()) {
+      EEPROM.write(address + header_size + next_commit_, image[next_commit_]);
+    }
+    dirty_.reset(next_commit_);
+    return;
+  }
+
+  // and the header last, ending with the magic, which makes this slot the newest good copy
+  const size_t length = StoredSize();
+  const uint16_t crc = Crc(std::span{image}.first(length));
+  const std::array<uint8_t, header_size> header = {
+      magic[0],
+      magic[1],
+      layout_version,
+      static_cast<uint8_t>(sequence_ + 1),
+      static_cast<uint8_t>(length & 0xFF),
+      static_cast<uint8_t>(length >> 8),
+      static_cast<uint8_t>(crc & 0xFF),
+      static_cast<uint8_t>(crc >> 8),
+  };
+  for (size_t i = header.size(); i-- > 0;) {
+    EEPROM.update(address + i, header[i]);
+  }
+
+  active_ ^= 1;
+  sequence_++;
+  committing_ = false;
+  unsaved_ = false;
+}
+
+/*
+ * Reads the config block in a slot, if its header and CRC check out
+ */
+bool ReadSlot(size_t slot, Config::Image& image, uint8_t& version, uint8_t& sequence) {
+  const int address = SlotAddress(slot);
+  const std::array header = eeprom::read<header_size>(address);
+  if (header[0] != magic[0] || header[1] != magic[1]) {
+    return false;
+  }
+
+  version = header[2];
+  sequence = header[3];
+  const size_t length = header[4] | (header[5] << 8);
+  const uint16_t crc = header[6] | (header[7] << 8);
+  DEBUG_PRINTF("Config slot %d: layout %d, sequence %d, %d bytes\n", slot, version, sequence, length);
+
+  if (version > layout_version || length > Config::SIZE || address + header_size + length > EEPROM.length()) {
+    DEBUG_PRINTLN("Config is from newer firmware");
+    return false;
+  }
+
+  // whatever the EEPROM is too small for comes from the defaults
+  image = Defaults();
+  for (size_t i = 0; i < length; i++) {
+    image[i] = EEPROM.read(address + header_size + i);
+  }
+
+  if (Crc(std::span{image}.first(length)) != crc) {
+    DEBUG_PRINTLN("Config failed its CRC");
+    return false;
+  }
+  return true;
+}
+
+void Config::Check() {
+  // the only time we read the EEPROM, from here on the image is the config.
+  // Of the slots that check out, the one written last wins.
+  bool found = false;
+  uint8_t version = 0;
+  for (size_t slot = 0; slot < num_slots; slot++) {
+    Image candidate;
+    uint8_t candidate_version;
+    uint8_t sequence;
+    if (!ReadSlot(slot, candidate, candidate_version, sequence) ||
+        (found && static_cast<int8_t>(sequence - sequence_) <= 0)) {
+      continue;
+    }
+    image = candidate;
+    version = candidate_version;
+    sequence_ = sequence;
+    active_ = slot;
+    found = true;
+  }
+
+  if (!found) {
+    // if byte1 of EEPROM is FF for whatever reason, let's assume the machine needs initializing
+    if (EEPROM.read(0) > 0x01) {
+      DEBUG_PRINTLN("No good config, probably needs initialising");
+      FactoryReset();
+      return;
+    }
+
+    // the old block is where the first slot is, so the new one goes in the other
+    DEBUG_PRINTLN("Config has no header, moving it to the current layout");
+    version = 0;
+    image = Defaults();
+    for (size_t i = 0; i < v0_size; i++) {
+      image[i] = EEPROM.read(i);
+    }
+    active_ = 0;
+  }
+
+  unsaved_ = false;
+
+  if (version < layout_version) {
+    for (uint8_t v = version; v < layout_version; v++) {
+      migrations[v](image);
+    }
+
+    // written out again in the new layout, in the other slot, so the old one is there until it's done
+    unsaved_ = true;
+  }
+
+  DEBUG_PRINTLN("Config found:");
+  debug::printArray(image);
+}
+
+void Config::FactoryReset() {
+  image = Defaults();
+
+  // any byte may have changed, so a commit under way starts over
+  unsaved_ = true;
+  committing_ = false;
+  edited_at_ = millis();
+
   // serial dump that config.
-  std::array buffer = eeprom::read<Config::SIZE>();
   DEBUG_PRINTLN("Config Instantiated.");
-  debug::printArray(buffer);
+  debug::printArray(image);
 }
 
-void Config::Load() {
-  for (int i = 0; i < kNumChannels; i++) {
-    usb_channels[i] = EEPROM.read(Config::MIDI_USB_CHANNEL + i);  // load usb channels
-    trs_channels[i] = EEPROM.read(Config::MIDI_TRS_CHANNEL + i);  // load TRS channels
+void Config::StorePreset(size_t preset) {
+  Edit(Config::PRESETS + (preset - 1) * Config::PRESET_SIZE, EncodePreset(mappings[0]));
+}
 
-    usb_ccs[i] = EEPROM.read(Config::MIDI_USB_CC + i);  // load USB ccs
-    trs_ccs[i] = EEPROM.read(Config::MIDI_TRS_CC + i);  // load TRS ccs
+void Config::Load() {
+  // every mapping is worked out now, so switching presets later costs nothing
+  mappings[0] = CompileMapping(image);
+  for (size_t preset = 1; preset <= NUM_PRESETS; preset++) {
+    mappings[preset] = CompilePreset(image, preset);
   }
 
-  DEBUG_PRINTLN("USB Channels loaded:");
-  debug::printArray(usb_channels);
-
-  DEBUG_PRINTLN("TRS Channels loaded:");
-  debug::printArray(trs_channels);
+  preset_channel = image[Config::PRESET_CHANNEL];
+  preset_snapshot = image[Config::PRESET_SNAPSHOT];
+  mapping = &mappings[std::min<size_t>(image[Config::PRESET_ACTIVE], NUM_PRESETS)];
 
-  DEBUG_PRINTLN("USB CCs loaded:");
-  debug::printArray(usb_ccs);
+  // i2c_master only read at startup, the followers are only routed to as a leader
+  routes = CompileRoutes(image, i2c_master);
 
-  DEBUG_PRINTLN("TRS CCs loaded:");
-  debug::printArray(trs_ccs);
+  DEBUG_PRINTF("Using mapping %d\n", mapping - mappings.data());
 
   // load other config
-  led_power = EEPROM.read(Config::LED_POWER);
-  led_data = EEPROM.read(Config::LED_DATA);
-  rotate = EEPROM.read(Config::ROTATE);
-  midi_thru = EEPROM.read(Config::MIDI_THRU);
+  led_power = image[Config::LED_POWER];
+  led_data = image[Config::LED_DATA];
+  rotate = image[Config::ROTATE];
+  midi_thru = image[Config::MIDI_THRU];
+
+  // with thru off, real time still goes from USB to TRS, as it always has
+  thru_usb_to_trs = midi_thru ? image[Config::THRU_USB_TO_TRS] : thru::realtime_filter;
+  thru_trs_to_usb = midi_thru ? image[Config::THRU_TRS_TO_USB] : 0;
+
+  hires_deadband = image[Config::HIRES_DEADBAND];
+
+  filter_mode = static_cast<FilterMode>(image[Config::FILTER_MODE] & 0x01);
+  filter_min_cutoff = image[Config::FILTER_MIN_CUTOFF];
+  filter_beta = image[Config::FILTER_BETA];
 
-  // i2c_master only read at startup
-  int faderminLSB = EEPROM.read(Config::FADERMIN_LSB);
-  int faderminMSB = EEPROM.read(Config::FADERMIN_MSB);
+  idle_timeout = image[Config::IDLE_TIMEOUT];
+
+  int faderminLSB = image[Config::FADERMIN_LSB];
+  int faderminMSB = image[Config::FADERMIN_MSB];
 
   DEBUG_PRINT("Setting fadermin to ");
   DEBUG_PRINTLN((faderminMSB << 7) + faderminLSB);
   fader_min = (faderminMSB << 7) + faderminLSB;
 
-  int fadermaxLSB = EEPROM.read(Config::FADERMAX_LSB);
-  int fadermaxMSB = EEPROM.read(Config::FADERMAX_MSB);
+  int fadermaxLSB = image[Config::FADERMAX_LSB];
+  int fadermaxMSB = image[Config::FADERMAX_MSB];
 
   DEBUG_PRINT("Setting fadermax to ");
   DEBUG_PRINTLN((fadermaxMSB << 7) + fadermaxLSB);
   fader_max = (fadermaxMSB << 7) + fadermaxLSB;
+
+  // work out each fader's mapping now, so mapping a reading is just a multiply and shift
+  for (int i = 0; i < kNumChannels; i++) {
+    // calibration is stored by physical fader, readings arrive already rotated
+    const int fader = rotate ? kNumChannels - i - 1 : i;
+    const int address = Config::CALIBRATION + 4 * fader;
+
+    uint16_t min = image[address] + (image[address + 1] << 7);
+    uint16_t max = image[address + 2] + (image[address + 3] << 7);
+
+    if (max < min + min_calibration_range) {
+      min = fader_min;
+      max = std::max<uint16_t>(fader_max, fader_min + 1);
+    }
+
+    // round the scale up, so max maps to 16383 exactly
+    const uint32_t range = max - min;
+    calibrations[i] = {min, max, ((16383u << 16) + range - 1) / range};
+  }
+
+  DEBUG_PRINTLN("Calibration loaded:");
+  for (int i = 0; i < kNumChannels; i++) {
+    DEBUG_PRINTF("%d-%d ", calibrations[i].min, calibrations[i].max);
+  }
+  DEBUG_PRINTLN();
 }
@@ -0,0 +1,140 @@
+/*
+ * 16n Faderbank fixed point input smoothing
+ * MIT License
+ */
+#include "filter.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include "scan.hpp"
+
+// the error moving average's weight for each new sample, 0.4 in Q.8
+constexpr int32_t error_weight = 102;
+
+// the cutoff for the adaptive filter's speed estimate
+constexpr float speed_cutoff = 5.0f;  // 5Hz
+
+/*
+ * The Q.16 smoothing factor for a first order low pass, sampled every frame_interval us
+ */
+int32_t Alpha(float cutoff, uint32_t frame_interval) {
+  const float tau = 1.0f / (2.0f * M_PI * cutoff);
+  const float interval = frame_interval / 1e6f;
+  return static_cast<int32_t>(65536.0f / (1.0f + tau / interval));
+}
+
+void FilterBank::Setup(int resolution, int activity_threshold, float snap_multiplier) {
+  resolution_ = resolution;
+  activity_threshold_ = activity_threshold;
+  snap_divisor_ = static_cast<uint32_t>(1.0f / snap_multiplier);
+
+  smooth_.fill(0);
+  error_.fill(0);
+  speed_.fill(0);
+  last_raw_.fill(0);
+  values_.fill(0);
+}
+
+void FilterBank::Configure(const Config& config) {
+  mode_ = config.filter_mode;
+  min_cutoff_ = config.filter_min_cutoff / 10.0f;
+  beta_per_ms_ = config.filter_beta / 10.0f;
+  Design();
+}
+
+void FilterBank::SetFrameInterval(uint32_t frame_interval) {
+  // the speeds are per frame, so carry them over to the new frames
+  for (auto& speed : speed_) {
+    speed = static_cast<int64_t>(speed) * frame_interval / frame_interval_;
+  }
+  frame_interval_ = frame_interval;
+  Design();
+}
+
+void FilterBank::Design() {
+  // the one-euro cutoff rises by beta for every count/ms of speed, and we measure speed in counts/frame.
+  // The smoothing factor comes from 2 pi cutoff interval, which is linear in the cutoff, so in the speed.
+  const float interval = frame_interval_ / 1e6f;                         // in s
+  const float beta_per_frame = beta_per_ms_ / (frame_interval_ / 1e3f);  // Hz per count/frame
+  min_rate_ = static_cast<int32_t>(65536.0f * 2.0f * M_PI * min_cutoff_ * interval);
+  beta_ = static_cast<int32_t>(65536.0f * 2.0f * M_PI * beta_per_frame * interval);
+  speed_alpha_ = Alpha(speed_cutoff, frame_interval_);
+}
+
+uint16_t FilterBank::Update(const Values& raw) {
+  const uint16_t changed = mode_ == Config::FilterMode::ADAPTIVE ? UpdateAdaptive(raw) : UpdateResponsive(raw);
+  last_raw_ = raw;
+  return changed;
+}
+
+uint16_t FilterBank::UpdateAdaptive(const Values& raw) {
+  uint16_t changed = 0;
+
+  for (size_t c = 0; c < kNumChannels; c++) {
+    const int32_t diff = (raw[c] << 16) - smooth_[c];
+
+    // estimate the speed from how far the input moved since the last frame,
+    // then open the filter up in proportion to it
+    const int32_t moved = (raw[c] - last_raw_[c]) << 16;
+    speed_[c] += (static_cast<int64_t>(moved - speed_[c]) * speed_alpha_) >> 16;
+    const int64_t rate = min_rate_ + ((static_cast<int64_t>(std::abs(speed_[c])) * beta_) >> 16);
+
+    // alpha = rate / (1 + rate), in Q.16, with a 32 bit divide
+    const uint32_t alpha = (1 << 16) - 0xFFFFFFFFu / ((1 << 16) + std::min<int64_t>(rate, 1 << 30));
+    smooth_[c] += (static_cast<int64_t>(diff) * alpha) >> 16;
+
+    // a count of hysteresis, so what noise is left can't flicker the output between two values
+    const int32_t centre = (values_[c] << 16) + (1 << 15);
+    if (std::abs(smooth_[c] - centre) <= 1 << 16) {
+      continue;
+    }
+
+    const uint16_t value = smooth_[c] >> 16;
+    if (value != values_[c]) {
+      values_[c] = value;
+      changed |= 1 << c;
+    }
+  }
+
+  return changed;
+}
+
+uint16_t FilterBank::UpdateResponsive(const Values& raw) {
+  uint16_t changed = 0;
+
+  for (size_t c = 0; c < kNumChannels; c++) {
+    int32_t input = raw[c];
+
+    // edge snap: stretch the input near the ends, so the output can reach them
+    if (input < activity_threshold_) {
+      input = (input * 2) - activity_threshold_;
+    }
+    else if (input > resolution_ - activity_threshold_) {
+      input = (input * 2) - resolution_ + activity_threshold_;
+    }
+
+    // track the error, and sleep while it stays under the threshold
+    const int32_t error = (input << 8) - (smooth_[c] >> 8);
+    error_[c] += ((error - error_[c]) * error_weight) >> 8;
+    if (std::abs(error_[c]) < (activity_threshold_ << 8)) {
+      continue;
+    }
+
+    // the further we are from the input, the harder we snap to it:
+    // snap = 2 * diff / (diff + 1 / multiplier), limited to 1
+    const uint32_t diff = std::abs(input - (smooth_[c] >> 16));
+    const int32_t snap = std::min<uint32_t>((diff << 17) / (diff + snap_divisor_), 1 << 16);
+
+    const int32_t step = (static_cast<int64_t>((input << 16) - smooth_[c]) * snap) >> 16;
+    smooth_[c] = std::clamp(smooth_[c] + step, 0, (resolution_ - 1) << 16);
+
+    const uint16_t value = smooth_[c] >> 16;
+    if (value != values_[c]) {
+      values_[c] = value;
+      changed |= 1 << c;
+    }
+  }
+
+  return changed;
+}
@@ -1,11 +1,15 @@
 #include "i2c.hpp"
 #include <Arduino.h>
 #include <i2c_t3.h>
+#include <algorithm>
 #include <array>
+#include <atomic>
 #include "TxHelper.hpp"
 #include "config.h"
 #include "configuration.hpp"
+#include "profile.hpp"
 #include "state.hpp"
+#include "telemetry.hpp"
 
 
 #if V125
@@ -16,15 +20,98 @@ auto& wire = Wire;
 constexpr auto I2C_PINS = I2C_PINS_29_30;
 #endif
 
-// helper values for i2c reading and future expansion
+// helper values for i2c reading and future expansion, only used from the i2c interrupt
 int activeInput = 0;
 int activeMode = 0;
 
 namespace i2c {
 
+/// What the next read from a leader answers with, as its last write asked
+enum class ReadMode : uint8_t {
+  FADER,    // the fader at activeInput
+  ALL,      // every fader
+  RANGE,    // read_count faders from read_first
+  CHANGED,  // a mask of the faders changed since the last read of changes, then each of them
+};
+
+ReadMode read_mode = ReadMode::FADER;
+size_t read_first = 0;
+size_t read_count = 0;
+
+// the fader values a leader reads, as of the last complete scan. loop() fills one while the interrupt
+// reads the other, then swaps them with a single store: the interrupt can't be interrupted by loop(),
+// so it never sees a half-written one, and neither side ever waits or masks interrupts.
+std::array<std::array<uint16_t, kNumChannels>, 2> snapshots{};
+std::atomic<uint8_t> published{0};
+
+// the values each fader last had in an answer to a read of changes, only used from the interrupt
+std::array<uint16_t, kNumChannels> reported{};
+
 // the i2c message buffer we are sending
 std::array<uint8_t, 4> messageBuffer;
 
+/// A follower we send to, with its error state
+struct Device {
+  uint8_t address;
+  bool State::*present;   // the flag in state that says it's on the bus
+  bool discoverable;      // we probe for it; when it stops answering, the whole follower is gone
+  uint8_t failures = 0;   // consecutive failed transfers
+  uint32_t retry_at = 0;  // leave it alone until millis() gets here
+};
+
+// the followers' addresses: TXo and Ansible can be chained, ER-301 is always one device
+std::array<Device, num_devices> devices{{
+    {addresses::txo, &State::has_txo, true},
+    {addresses::txo + 1, &State::has_txo, false},
+    {addresses::txo + 2, &State::has_txo, false},
+    {addresses::txo + 3, &State::has_txo, false},
+    {addresses::er301, &State::has_er301, true},
+    {addresses::ansible, &State::has_ansible, true},
+    {addresses::ansible + 2, &State::has_ansible, false},
+    {addresses::ansible + 4, &State::has_ansible, false},
+    {addresses::ansible + 6, &State::has_ansible, false},
+}};
+
+/// The newest value for one i2c destination
+struct Slot {
+  uint8_t device;  // index into devices
+  uint16_t value = 0;
+  bool pending = false;
+};
+
+// one slot per destination in the shared routes, only the i2c ones are used
+std::array<Slot, Config::SHARED_ROUTES> slots;
+
+// what's on the bus: the slot being sent or the device being probed
+int in_flight = -1;
+int probing = -1;
+uint32_t in_flight_since;
+
+// where the round robin picks up
+size_t next_slot = 0;
+
+// the next discoverable device to probe, devices.size() once a round of discovery is over
+size_t next_probe = devices.size();
+uint32_t next_discovery_at = 0;
+
+constexpr uint32_t transfer_timeout = 2000;    // 2ms, a 4 byte message takes ~120us at 400kHz
+constexpr uint32_t service_budget = 200;       // 200us
+constexpr uint32_t max_backoff = 1000;         // 1s
+constexpr uint32_t discovery_interval = 1000;  // 1s
+constexpr uint8_t lost_after = 3;              // failed transfers before a follower is gone
+
+bool IsPresent(const Device& device) {
+  return state.*device.present;
+}
+
+size_t FindDevice(uint8_t address) {
+  size_t d = 0;
+  while (d < devices.size() && devices[d].address != address) {
+    d++;
+  }
+  return d;
+}
+
 void Setup() {
   // i2c using the default I2C pins on a Teensy 3.2
   if (config.i2c_master) {
@@ -32,31 +119,15 @@ void Setup() {
     wire.begin(I2C_MASTER, I2C_ADDRESS, I2C_PINS, I2C_PULLUP_EXT, 400000);
     wire.setDefaultTimeout(10000);  // 10ms
 
-    DEBUG_PRINTLN("Scanning I2C bus");
-
     wire.begin();
 
-    for (byte i = 8; i < 120; i++) {
-      wire.beginTransmission(i);
-      if (wire.endTransmission() == 0) {
-        if (i == addresses::ansible) {
-          state.has_ansible = true;
-          DEBUG_PRINTLN("Found ansible");
-        }
+    for (size_t d = 0; d < devices.size(); d++) {
+      telemetry.followers[d].address = devices[d].address;
+    }
 
-        if (i == addresses::txo) {
-          state.has_txo = true;
-          DEBUG_PRINTLN("Found TXO");
-        }
+    // where each fader goes on each follower is in the shared routes, see Config::Load()
 
-        if (i == addresses::er301) {
-          state.has_er301 = true;
-          DEBUG_PRINTLN("Found ER301");
-        }
-        delay(1);  // maybe unneeded?
-      }            // end of good response
-    }              // end of for loop
-    DEBUG_PRINTLN("I2C scan complete.");
+    // followers are found in the background by Service(), so we don't hold up MIDI at boot
   }
 
   // non-master mode
@@ -68,23 +139,211 @@ void Setup() {
   }
 }
 
+void Queue(size_t route, uint16_t value) {
+  const uint8_t device = config.routes.destinations[route].device;
+
+  // only count it for the followers that are there, or everything would be coalesced
+  Slot& slot = slots[route];
+  telemetry.i2c_coalesced += slot.pending && IsPresent(devices[device]);
+  slot.device = device;
+  slot.value = value;
+  slot.pending = true;
+}
+
 /*
- * Sends an i2c command out to a slave when running in master mode
+ * Queues every fader's current value for a follower that has just appeared
  */
-void Send(uint8_t model, uint8_t deviceIndex, uint8_t cmd, uint8_t devicePort, uint16_t value) {
-  messageBuffer[2] = value >> 8;
-  messageBuffer[3] = value & 0xff;
-
-  wire.beginTransmission(model + deviceIndex);
-  messageBuffer[0] = cmd;
-  messageBuffer[1] = (uint8_t)devicePort;
-  wire.write(messageBuffer.data(), messageBuffer.size());
-  wire.endTransmission();
+void Resend(const Device& device) {
+  const Config::SharedRoutes& routes = config.routes;
+  for (size_t c = 0; c < kNumChannels; c++) {
+    for (size_t s = routes.first[c]; s < routes.first[c + 1]; s++) {
+      const Config::Destination& destination = routes.destinations[s];
+      if (destination.port == Config::Port::I2C && devices[destination.device].present == device.present) {
+        slots[s] = {destination.device, static_cast<uint16_t>(destination.Scale(state.current[c])), true};
+      }
+    }
+  }
+}
+
+/*
+ * Checks how the transfer in flight went, and backs off its device if it failed
+ */
+void FinishTransfer(bool timed_out) {
+  Slot& slot = slots[in_flight];
+  Device& device = devices[slot.device];
+  auto& counters = telemetry.followers[slot.device];
+  in_flight = -1;
+
+  counters.transfers++;
+  if (timed_out || wire.status() == I2C_TIMEOUT) {
+    counters.timeouts++;
+  }
+  else if (wire.status() == I2C_ADDR_NAK || wire.status() == I2C_DATA_NAK) {
+    counters.naks++;
+  }
+
+  if (!timed_out && wire.status() == I2C_WAITING) {
+    device.failures = 0;
+    return;
+  }
+
+  DEBUG_PRINTF("i2c send to %02X failed: %d\n", device.address, wire.status());
+
+  // keep the value for when the device comes back, unless a newer one has replaced it already
+  slot.pending = true;
+
+  // wait twice as long after each consecutive failure
+  device.failures = std::min(device.failures + 1, 8);
+  device.retry_at = millis() + std::min<uint32_t>(4 << device.failures, max_backoff);
+
+  if (device.failures < lost_after) {
+    return;
+  }
+
+  if (device.discoverable) {
+    DEBUG_PRINTF("Lost follower at %02X\n", device.address);
+    state.*device.present = false;
+    return;
+  }
+
+  // a chained address can't be probed, and most followers aren't chained: stop trying the values
+  // waiting for it. It gets the next one a fader sends it, and every one again when its follower is found.
+  for (Slot& waiting : slots) {
+    waiting.pending &= &devices[waiting.device] != &device;
+  }
+}
+
+/*
+ * Checks whether a probed device answered, and starts sending to it if it did
+ */
+void FinishProbe() {
+  Device& device = devices[probing];
+  probing = -1;
+
+  if (wire.status() != I2C_WAITING) {
+    return;
+  }
+
+  DEBUG_PRINTF("Found follower at %02X\n", device.address);
+  state.*device.present = true;
+  device.failures = 0;
+  Resend(device);
+}
+
+/*
+ * Starts probing the next follower we haven't found yet, once per discovery interval.
+ * Returns false if there was nothing to probe.
+ */
+bool StartProbe() {
+  if (next_probe == devices.size()) {
+    if (static_cast<int32_t>(millis() - next_discovery_at) < 0) {
+      return false;
+    }
+    next_discovery_at = millis() + discovery_interval;
+    next_probe = 0;
+  }
+
+  // only the known addresses, and only the ones that aren't already there
+  while (next_probe < devices.size() && (!devices[next_probe].discoverable || IsPresent(devices[next_probe]))) {
+    next_probe++;
+  }
+  if (next_probe == devices.size()) {
+    return false;
+  }
+
+  probing = next_probe++;
+  wire.beginTransmission(devices[probing].address);
+  wire.sendTransmission(I2C_STOP);
+  in_flight_since = micros();
+  return true;
+}
+
+/*
+ * Starts sending the next waiting value to a device that isn't backed off.
+ * Returns false if there was nothing to send.
+ */
+bool StartTransfer() {
+  const uint32_t now = millis();
+
+  for (size_t i = 0; i < slots.size(); i++) {
+    const size_t s = (next_slot + i) % slots.size();
+    Slot& slot = slots[s];
+    const Device& device = devices[slot.device];
+
+    if (!slot.pending || !IsPresent(device)) {
+      continue;
+    }
+
+    if (device.failures && static_cast<int32_t>(now - device.retry_at) < 0) {
+      continue;
+    }
+
+    const Config::Destination& destination = config.routes.destinations[s];
+    messageBuffer[0] = destination.number;
+    messageBuffer[1] = destination.output;
+    messageBuffer[2] = slot.value >> 8;
+    messageBuffer[3] = slot.value & 0xff;
+
+    wire.beginTransmission(device.address);
+    wire.write(messageBuffer.data(), messageBuffer.size());
+    wire.sendTransmission(I2C_STOP);
+
+    slot.pending = false;
+    in_flight = s;
+    in_flight_since = micros();
+    next_slot = (s + 1) % slots.size();
+    return true;
+  }
+  return false;
+}
+
+void Service() {
+  if (!config.i2c_master) {
+    return;
+  }
+
+  profile::Scope scope{profile::I2C};
+  const uint32_t started = micros();
+  do {
+    if (in_flight >= 0 || probing >= 0) {
+      bool timed_out = false;
+      if (!wire.done()) {
+        if (micros() - in_flight_since < transfer_timeout) {
+          return;  // still going, check back next time
+        }
+
+        // the bus is stuck, free it and count it against the device
+        wire.resetBus();
+        timed_out = true;
+      }
+
+      if (probing >= 0) {
+        FinishProbe();
+      }
+      else {
+        FinishTransfer(timed_out);
+      }
+    }
+
+    if (!StartProbe() && !StartTransfer()) {
+      return;
+    }
+  } while (micros() - started < service_budget);
+}
+
+void Publish() {
+  if (config.i2c_master) {
+    return;
+  }
+
+  const uint8_t next = published.load(std::memory_order_relaxed) ^ 1;
+  std::copy(state.current.begin(), state.current.end(), snapshots[next].begin());
+  published.store(next, std::memory_order_release);
 }
 
 /*
  * The function that responds to a command from i2c.
- * In the first version, this simply sets the port to be read from.
+ * A single byte sets the port to be read from, anything longer is a command.
  */
 void Write(size_t len) {
   DEBUG_PRINTF("i2c Write (%d)\n", len);
@@ -99,9 +358,10 @@ void Write(size_t len) {
 
     DEBUG_PRINTF("Port: %d; Mode: %d [%d]\n", io.Port, io.Mode, response.Command);
 
-    // this is the single byte that sets the active input
-    activeInput = io.Port;
+    // this is the single byte that sets the active input, kept in range whatever TxHelper's port count
+    activeInput = io.Port % kNumChannels;
     activeMode = io.Mode;
+    read_mode = ReadMode::FADER;
   }
   else {
     // act on the command
@@ -111,24 +371,82 @@ void Write(size_t len) {
 
 /*
  * The function that responds to read requests over i2c.
- * This uses the port from the write request to determine which slider to send.
+ * This answers with the faders the last write asked for, from the last complete scan.
  */
 void ReadRequest() {
   DEBUG_PRINT("i2c Read\n");
 
-  // get and cast the value
-  auto shiftReady = static_cast<uint16_t>(state.current[activeInput]);
+  const auto& snapshot = snapshots[published.load(std::memory_order_acquire)];
+
+  // each value goes out as a pair of bytes, MSB first
+  std::array<uint8_t, 2 + 2 * kNumChannels> response;
+  size_t length = 0;
+  auto add = [&](uint16_t value) {
+    response[length++] = value >> 8;
+    response[length++] = value & 255;
+  };
+
+  switch (read_mode) {
+    case ReadMode::FADER:
+      DEBUG_PRINTF("delivering: %d; value: %d\n", activeInput, snapshot[activeInput]);
+      add(snapshot[activeInput]);
+      break;
 
-  DEBUG_PRINTF("delivering: %d; value: %d [%d]\n", activeInput, state.current[activeInput], shiftReady);
+    case ReadMode::ALL:
+      for (uint16_t value : snapshot) {
+        add(value);
+      }
+      break;
 
-  // send the puppy as a pair of bytes
-  wire.write(shiftReady >> 8);
-  wire.write(shiftReady & 255);
+    case ReadMode::RANGE:
+      for (size_t c = read_first; c < read_first + read_count; c++) {
+        add(snapshot[c]);
+      }
+      break;
+
+    case ReadMode::CHANGED: {
+      // the mask, then only the faders in it
+      uint16_t changed = 0;
+      for (size_t c = 0; c < kNumChannels; c++) {
+        changed |= (snapshot[c] != reported[c]) << c;
+      }
+      add(changed);
+      for (size_t c = 0; c < kNumChannels; c++) {
+        if (changed & (1 << c)) {
+          add(snapshot[c]);
+          reported[c] = snapshot[c];
+        }
+      }
+      break;
+    }
+  }
+
+  wire.write(response.data(), length);
 }
 
 /*
- * Future function if we add more i2c capabilities beyond reading values.
+ * Sets up a bulk read: the next read answers with every fader, a range of them,
+ * or the ones that have changed since the last read of changes
  */
 void actOnCommand(uint8_t cmd, uint8_t out, int value) {
+  switch (cmd) {
+    case commands::read_all:
+      read_mode = ReadMode::ALL;
+      break;
+
+    case commands::read_range:
+      read_first = std::min<size_t>(out, kNumChannels);
+      read_count = std::clamp<int>(value, 0, kNumChannels - read_first);
+      read_mode = ReadMode::RANGE;
+      break;
+
+    case commands::read_changed:
+      read_mode = ReadMode::CHANGED;
+      break;
+
+    default:
+      DEBUG_PRINTF("Unknown i2c command %d\n", cmd);
+      break;
+  }
 }
 }  // namespace i2c
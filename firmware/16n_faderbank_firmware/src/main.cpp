@@ -15,31 +15,40 @@
  * Most configuration now hpapens via online editor.
  * config.h is mainly for developer configuration.
  */
-#include <CD74HC4067.h>
-#include <EEPROM.h>
-#include <ResponsiveAnalogRead.h>
 #include <algorithm>
 #include "TxHelper.hpp"
+#include "calibration.hpp"
 #include "config.h"
 #include "configuration.hpp"
+#include "filter.hpp"
 #include "i2c.hpp"
 #include "midi.hpp"
+#include "power.hpp"
+#include "profile.hpp"
+#include "scan.hpp"
+#include "scheduler.hpp"
 #include "state.hpp"
 #include "sysex.hpp"
+#include "telemetry.hpp"
+#include "trs.hpp"
 
-constexpr auto kNumBitsADC = 13;  // 13 bit ADC resolution on Teensy 3.2
 constexpr int LED_PIN = 13;
 
 // variables to hold configuration
 Config config{};
 State state{};
+Telemetry telemetry{};
 
 // Input smoothers
-std::array<ResponsiveAnalogRead, kNumChannels> analog;
+FilterBank filters;
 
-// mux config
-CD74HC4067 mux{8, 7, 6, 5};
-constexpr std::array mux_map = {0, 1, 2, 3, 4, 5, 6, 7, 15, 14, 13, 12, 11, 10, 9, 8};
+// the LED is inverted for a moment when MIDI goes out
+static bool flashing = false;
+static bool led_on = false;
+static scheduler::Task end_flash;
+
+void ReadFrame();
+void UpdateLed();
 
 /*
  * The function that sets up the application
@@ -47,13 +56,11 @@ constexpr std::array mux_map = {0, 1, 2, 3, 4, 5, 6, 7, 15, 14, 13, 12, 11, 10,
 void setup() {
   DEBUG_PRINTLN("16n Firmware Debug Mode");
 
+  profile::Setup();
+
   config.Check();
+  config.i2c_master = config.image[Config::I2C_MASTER];
   config.Load();
-  config.i2c_master = EEPROM.read(Config::I2C_MASTER);
-
-  if (config.i2c_master) {
-    delay(BOOTDELAY);
-  }
 
   if constexpr (V125) {
     // analog ports on the Teensy for the 1.25 board.
@@ -73,79 +80,81 @@ void setup() {
   TxHelper::SetPorts(16);
   TxHelper::SetModes(4);
 
-  // set read resolution to teensy's 13 usable bits
-  analogReadResolution(kNumBitsADC);
-
-  // initialize the analog reader
-  for (auto& reader : analog) {
-    reader = ResponsiveAnalogRead(0, true, .0001);
-    reader.setAnalogResolution(1 << kNumBitsADC);
-
-    // ResponsiveAnalogRead is designed for 10-bit ADCs
-    // meanining its threshold defaults to 4. Let's bump that for
-    // our 13-bit adc by setting it to 4 << (13-10)
-    reader.setActivityThreshold(32);
-  }
+  // initialize the input smoothers.
+  // ResponsiveAnalogRead, which they're based on, is designed for 10-bit ADCs
+  // meaning its threshold defaults to 4. Let's bump that for
+  // our 13-bit adc by setting it to 4 << (13-10)
+  filters.Setup(1 << scan::resolution, 32, .0001);
+  filters.Configure(config);
 
   i2c::Setup();
+  MIDI::Setup();
+  scan::Setup();
 
   pinMode(LED_PIN, OUTPUT);
-  digitalWrite(LED_PIN, config.led_power);
-}
+  led_on = config.led_power;
+  digitalWrite(LED_PIN, led_on);
 
-int ReadChannel(int channel) {
-  if constexpr (V125) {
-    return analogRead(config.legacy_ports[channel]);
+  if constexpr (TRACE_ADC) {
+    Serial.printf("# 16n ADC trace v1: %d bit samples, %dus frames\n", scan::resolution, scan::frame_interval);
   }
 
-  // set mux to appropriate channel
-  auto mux_channel = config.rotate ? kNumChannels - channel - 1 : channel;
-  mux.channel(mux_map[mux_channel]);
-
-  // wait for the mux channel to change
-  delayMicroseconds(10);
-
-  // read the value
-  return analogRead(0);  // mux goes into A0
+  scan::Start();
+  MIDI::Start();
+
+  // everything the main loop does, how often, and how soon after it's due it has to start
+  using scheduler::BACKGROUND, scheduler::NORMAL, scheduler::URGENT;
+  scheduler::Every(0, URGENT, scan::frame_interval, ReadFrame);
+  scheduler::Every(MIDI::interval, URGENT, MIDI::interval, MIDI::Write);
+  scheduler::Every(0, URGENT, MIDI::interval, trs::Service);  // as fast as the UART takes it
+  scheduler::Every(MIDI::interval, NORMAL, MIDI::interval, MIDI::Read);
+  scheduler::Every(0, NORMAL, MIDI::interval, i2c::Service);
+  scheduler::Every(MIDI::interval, BACKGROUND, 10 * MIDI::interval, UpdateLed);
+  scheduler::Every(MIDI::interval, BACKGROUND, 10 * MIDI::interval, sysex::Service);
+
+  // edits reach EEPROM a byte at a time, once everything else is done
+  scheduler::Every(0, BACKGROUND, 100 * MIDI::interval, [] { config.Commit(); });
+  end_flash = scheduler::Once(BACKGROUND, 10 * MIDI::interval, [] { flashing = false; });
 }
 
 /*
- * The main read loop that goes through all of the sliders
+ * Writes a raw frame out as one line of an ADC trace:
+ * the time it was completed in microseconds, then each channel's sample, separated by spaces
  */
-void loop() {
-  // this whole chunk makes the LED flicker on MIDI activity -
-  // and inverts that flicker if the power light is on.
-  if (config.led_data) {
-    if (millis() > (MIDI::last_activity_at + MIDI::flash_duration)) {
-      digitalWrite(LED_PIN, config.led_power);
-      MIDI::get_and_clear_activity();
-    }
-    else {
-      digitalWrite(LED_PIN, !config.led_power);
-    }
-  }
-  else {
-    digitalWrite(LED_PIN, config.led_power);
+void TraceFrame(const scan::Frame& frame) {
+  Serial.printf("%u", static_cast<unsigned>(scan::frame_time()));
+  for (uint16_t sample : frame) {
+    Serial.printf(" %u", sample);
   }
+  Serial.println();
+}
 
-  if (state.forced_control_update.should_send && (millis() > state.forced_control_update.send_at)) {
-    // it's now time to send a forced control update, so...
-    state.forced_control_update.should_send = false;  // mark message as sent
+/*
+ * Runs a complete frame of raw samples through the smoothers and maps them
+ */
+void UpdateChannels(const scan::Frame& frame) {
+  profile::Scope scope{profile::CHANNELS};
 
-    MIDI::force_write();  // force a write the next time the Midi::Write callback fires.
+  if constexpr (TRACE_ADC) {
+    TraceFrame(frame);
   }
 
-  for (int i = 0; i < kNumChannels; i++) {
-    const int raw = ReadChannel(i);
+  state.raw = frame;
 
-    // put the value into the smoother
-    analog[i].update(raw);
+  // put the values into the smoothers
+  const uint16_t changed = filters.Update(frame);
 
-    if (analog[i].hasChanged()) {
-      // read from the smoother, constrain (to account for tolerances), and map it
-      uint16_t value = analog[i].getValue();
-      value = std::clamp(value, config.fader_min, config.fader_max);
-      value = map(value, config.fader_min, config.fader_max, 0, 16383);
+  // calibrating counts as moving, the faders are about to be
+  power::Update(frame, changed || calibration::active());
+
+  if (calibration::active()) {
+    calibration::Track(filters);
+  }
+
+  for (int i = 0; i < kNumChannels; i++) {
+    if (changed & (1 << i)) {
+      // read from the smoother, and constrain and map it with the fader's calibration
+      uint16_t value = config.calibrations[i].Map(filters.value(i));
 
       if (config.rotate) {
         value = 16383 - value;
@@ -153,9 +162,49 @@ void loop() {
 
       // map and update the value
       state.current[i] = value;
+      MIDI::Changed(i);
     }
   }
 
-  MIDI::Read();
-  MIDI::Write();
+  i2c::Publish();
+  MIDI::Flush();
+}
+
+/*
+ * Picks up a completed frame, if there is one. The scan runs in the background.
+ */
+void ReadFrame() {
+  scan::Frame frame;
+  if (scan::Read(frame)) {
+    UpdateChannels(frame);
+  }
+}
+
+/*
+ * Shows the power light, and flickers it on MIDI activity - inverting the flicker if the power light is on
+ */
+void UpdateLed() {
+  if (config.led_data && !flashing && MIDI::get_and_clear_activity()) {
+    flashing = true;
+    scheduler::Arm(end_flash, MIDI::flash_duration * 1000);
+  }
+
+  // only touch the pin when it changes
+  const bool on = flashing ? !config.led_power : config.led_power;
+  if (on != led_on) {
+    digitalWrite(LED_PIN, on);
+    led_on = on;
+  }
+}
+
+/*
+ * The main loop, which runs whatever is due
+ */
+void loop() {
+  profile::Scope scope{profile::LOOP};
+  telemetry.CountLoop();
+  scheduler::Run();
+
+  // when idle, nothing needs doing until something interrupts
+  power::Sleep();
 }
@@ -1,32 +1,34 @@
 #include "midi.hpp"
 
 #include <Arduino.h>
-#include <MIDI.h>
 #include "configuration.hpp"
 #include "i2c.hpp"
+#include "profile.hpp"
 #include "state.hpp"
 #include "sysex.hpp"
-
-midi::SerialMIDI<HardwareSerial> serialserialMIDI{Serial1};
-midi::MidiInterface<midi::SerialMIDI<HardwareSerial>> serialMIDI{
-    static_cast<midi::SerialMIDI<HardwareSerial>&>(serialserialMIDI)};
-
-static bool needs_write = false;
-static bool needs_read = false;
+#include "telemetry.hpp"
+#include "thru.hpp"
+#include "trs.hpp"
 
 static bool force_write_ = false;
 
+// USB messages have been written since the last flush
+static bool usb_pending = false;
+
 static bool had_activity = false;
 
-// MIDI timers
-static IntervalTimer write_timer;
-static IntervalTimer read_timer;
+// the last value sent to each destination, at full resolution
+static std::array<int, Config::NUM_DESTINATIONS> history;
 
-static std::array<int, kNumChannels> history;
+// the 7-bit step each destination was in last time round, and how many times it has changed step since
+// the last send: without the hysteresis, each of those would have been a message. Counts the messages it saves.
+static std::array<int, Config::NUM_DESTINATIONS> last_steps;
+static std::array<uint8_t, Config::NUM_DESTINATIONS> held_steps;
 
-namespace MIDI {
+// how far past the edge of a 7-bit step a value has to go before it's in the next one
+constexpr int step_hysteresis = 32;  // a quarter of a step
 
-uint32_t last_activity_at;
+namespace MIDI {
 
 void force_write() {
   force_write_ = true;
@@ -40,147 +42,164 @@ bool get_and_clear_activity() {
 
 void ReadInternal();
 void WriteInternal();
+void WriteChannel(size_t c);
 
-void Setup() {
-  usbMIDI.setHandleSystemExclusive(sysex::Parse);
-  usbMIDI.setHandleRealTimeSystem([](uint8_t realtimebyte) {
-    serialMIDI.sendRealTime(static_cast<midi::MidiType>(realtimebyte));  //<
-  });
-
-  if (config.midi_thru) {
-    usbMIDI.setHandleNoteOff([](uint8_t channel, uint8_t note, uint8_t velocity) {  //<
-      serialMIDI.sendNoteOff(note, velocity, channel);
-    });
-
-    usbMIDI.setHandleNoteOn([](uint8_t channel, uint8_t note, uint8_t velocity) {  //<
-      serialMIDI.sendNoteOn(note, velocity, channel);
-    });
-
-    usbMIDI.setHandleAfterTouchPoly([](uint8_t channel, uint8_t note, uint8_t velocity) {  //<
-      serialMIDI.sendAfterTouch(note, velocity, channel);
-    });
-
-    usbMIDI.setHandleControlChange([](uint8_t channel, uint8_t control, uint8_t value) {  //<
-      serialMIDI.sendControlChange(control, value, channel);
-    });
-
-    usbMIDI.setHandleProgramChange([](uint8_t channel, uint8_t program) {  //<
-      serialMIDI.sendProgramChange(program, channel);
-    });
-
-    usbMIDI.setHandleAfterTouch([](uint8_t channel, uint8_t pressure) {  //<
-      serialMIDI.sendAfterTouch(pressure, channel);
-    });
-
-    usbMIDI.setHandleTimeCodeQuarterFrame([](uint8_t data) {  //<
-      serialMIDI.sendTimeCodeQuarterFrame(data);
-    });
-
-    usbMIDI.setHandleSongPosition([](uint16_t beats) {  //<
-      serialMIDI.sendSongPosition(beats);
-    });
-
-    usbMIDI.setHandleSongSelect([](uint8_t songNumber) {  //<
-      serialMIDI.sendSongSelect(songNumber);
-    });
-
-    usbMIDI.setHandleTuneRequest([] {  //<
-      serialMIDI.sendTuneRequest();
-    });
+/*
+ * Has the value moved far enough from the last one sent to be worth sending to this destination?
+ */
+bool HasChanged(const Config::Destination& destination, int value, int last) {
+  // followers get every change, they have the resolution for it
+  if (destination.port == Config::Port::I2C) {
+    return value != last;
+  }
+
+  if (destination.resolution == Config::Resolution::CC_7BIT) {
+    // a fader resting on the edge of a step would otherwise flip between two values forever
+    const int step_start = last & ~0x7F;
+    return value < step_start - step_hysteresis || value >= step_start + 128 + step_hysteresis;
+  }
+
+  // always let the ends through, so the deadband can't leave a fader short of them
+  if (value == 0 || value == 16383) {
+    return value != last;
   }
+  return std::abs(value - last) > config.hires_deadband;
+}
+
+void Setup() {
+  // SysEx comes in chunks as it arrives, everything else is dealt with by thru::Read()
+  usbMIDI.setHandleSystemExclusive(sysex::Receive);
 }
 
 void Start() {
   // turn on the MIDI party
-  serialMIDI.begin();
-  write_timer.begin([] { needs_write = true; }, interval);
-  read_timer.begin([] { needs_read = true; }, interval);
+  trs::Start();
 }
 
 void Read() {
-  if (!needs_read) {
-    return;
-  }
+  profile::Scope scope{profile::MIDI_READ};
+  thru::Read();
+}
 
-  serialMIDI.read();
-  usbMIDI.read();
+void Write() {
+  if constexpr (MIDI_IMMEDIATE) {
+    // changes have already gone out from Changed(), only forced updates are left
+    if (force_write_) {
+      WriteInternal();
+      Flush();
+    }
+  }
+  else {
+    WriteInternal();
+  }
+}
 
-  noInterrupts();
-  needs_read = false;
-  interrupts();
+void Changed(size_t channel) {
+  if constexpr (MIDI_IMMEDIATE) {
+    WriteChannel(channel);
+  }
 }
 
-void Write() {
-  if (!needs_write) {
+void Flush() {
+  // in timed mode the USB stack sends on its own schedule, as it always has.
+  // TRS needs no flush either way, Serial1 is drained by its TX interrupt.
+  if constexpr (!MIDI_IMMEDIATE) {
     return;
   }
 
-  WriteInternal();
-  noInterrupts();
-  needs_write = false;
-  interrupts();
+  if (usb_pending) {
+    usbMIDI.send_now();
+    usb_pending = false;
+  }
 }
 
 /*
- * The function that writes changes in slider positions out the midi ports
- * Called when needs_write flag is HIGH
+ * Sends a fader to each of its destinations in a routing table that its value has changed for.
+ * base is the number of the table's first destination. Returns whether any MIDI went out.
  */
-void WriteInternal() {
-  // midi write helpers
-  static int shiftyTemp;
-  static int notShiftyTemp;
-
-  for (size_t c = 0; c < kNumChannels; c++) {
-    notShiftyTemp = state.current[c];
-
-    // shift for MIDI precision (0-127)
-    shiftyTemp = notShiftyTemp >> 7;
-
-    // if there was a change in the midi value
-    if ((shiftyTemp != history[c]) || force_write_) {
-      if (config.led_data && !had_activity) {
-        last_activity_at = millis();
-        had_activity = true;
+template <size_t N>
+bool WriteRoutes(const Config::Routes<N>& routes, size_t base, size_t c, int value) {
+  bool sent = false;
+  for (size_t i = routes.first[c]; i < routes.first[c + 1]; i++) {
+    const Config::Destination& destination = routes.destinations[i];
+    const size_t d = base + i;
+    const int scaled = destination.Scale(value);
+    const bool changed = HasChanged(destination, scaled, history[d]);
+
+    // a crossing held back is only saved if it never goes out: the value comes back to the step last sent
+    const bool stepped = destination.port != Config::Port::I2C && destination.resolution == Config::Resolution::CC_7BIT;
+    const int step = scaled >> 7;
+    if (stepped && step != last_steps[d]) {
+      last_steps[d] = step;
+      held_steps[d]++;
+      if (!changed && step == history[d] >> 7) {
+        telemetry.suppressed += held_steps[d];
+        held_steps[d] = 0;
       }
-      // send the message over USB and physical MIDI
-      usbMIDI.sendControlChange(config.usb_ccs[c], shiftyTemp, config.usb_channels[c]);
-      serialMIDI.sendControlChange(config.trs_ccs[c], shiftyTemp, config.trs_channels[c]);
-
-      // store the shifted value for future comparison
-      history[c] = shiftyTemp;
-
-      DEBUG_PRINTF("MIDI[%d]: %d\n", c, shiftyTemp);
     }
 
-    if (config.i2c_master) {
-      // we send out to all three supported i2c slave devices
-      // keeps the firmware simple :)
+    // a forced update is for the MIDI ports, the followers already have every value
+    if (!changed && (!force_write_ || destination.port == Config::Port::I2C)) {
+      continue;
+    }
+    history[d] = scaled;
 
-      if (notShiftyTemp != state.last[c]) {
-        DEBUG_PRINTF("i2c Master[%d]: %d\n", c, notShiftyTemp);
+    // or one send stands in for every crossing since the last
+    if (stepped) {
+      telemetry.suppressed += held_steps[d] - (changed && held_steps[d]);
+      held_steps[d] = 0;
+    }
 
-        // for 4 output devices
-        uint8_t port = c % 4;
-        uint8_t device = c / 4;
+    switch (destination.port) {
+      case Config::Port::USB:
+        SendControl(usbMIDI, destination.resolution, destination.number, scaled, destination.channel);
+        usb_pending = true;
+        telemetry.usb_messages++;
+        sent = true;
+        DEBUG_PRINTF("USB MIDI[%d]: %d\n", c, scaled);
+        break;
+
+      case Config::Port::TRS:
+        trs::Queue(d, scaled);
+        sent = true;
+        DEBUG_PRINTF("TRS MIDI[%d]: %d\n", c, scaled);
+        break;
+
+      case Config::Port::I2C:
+        // only ever in the shared routes, where its place in the table is its i2c slot
+        i2c::Queue(i, scaled);
+        DEBUG_PRINTF("i2c Master[%d]: %d\n", c, scaled);
+        break;
+
+      case Config::Port::NONE:
+        break;
+    }
+  }
+  return sent;
+}
 
-        // TXo
-        if (state.has_txo) {
-          i2c::Send(i2c::addresses::txo, device, 0x11, port, notShiftyTemp);
-        }
+/*
+ * Writes a single fader out to every destination it's routed to, if it has changed
+ */
+void WriteChannel(size_t c) {
+  const int notShiftyTemp = state.current[c];
 
-        // ER-301
-        if (state.has_er301) {
-          i2c::Send(i2c::addresses::er301, 0, 0x11, c, notShiftyTemp);
-        }
+  bool sent = WriteRoutes(*config.mapping, 0, c, notShiftyTemp);
+  sent |= WriteRoutes(config.routes, Config::FIRST_SHARED, c, notShiftyTemp);
 
-        // ANSIBLE
-        if (state.has_ansible) {
-          i2c::Send(0x20, device << 1, 0x06, port, notShiftyTemp);
-        }
+  if (sent && config.led_data) {
+    had_activity = true;
+  }
+}
 
-        state.last[c] = notShiftyTemp;
-      }
-    }
+/*
+ * The function that writes changes in slider positions out the midi ports.
+ * Runs as the scheduler's MIDI::Write task every MIDI::interval.
+ */
+void WriteInternal() {
+  profile::Scope scope{profile::MIDI_WRITE};
+  for (size_t c = 0; c < kNumChannels; c++) {
+    WriteChannel(c);
   }
   force_write_ = false;
 }
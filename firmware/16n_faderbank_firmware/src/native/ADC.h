@@ -0,0 +1,30 @@
+#pragma once
+/*
+ * Host stand-in for the ADC library: a conversion completes a few microseconds of simulated time
+ * after it's started, reading whatever the mux is pointing at.
+ */
+#include <cstdint>
+
+class ADC_Module {
+ public:
+  static constexpr uint32_t conversion_time = 8;  // us
+
+  void setResolution(uint8_t bits);
+  void setAveraging(uint8_t samples);
+  bool startSingleRead(uint8_t pin);
+  int readSingle();
+  void enableInterrupts(void (*isr)(), uint8_t priority = 255);
+  void disableInterrupts();
+
+  void (*isr_)() = nullptr;
+  uint8_t pin_ = 0;
+  uint64_t done_at_ = UINT64_MAX;
+};
+
+class ADC {
+ public:
+  ADC_Module* const adc0 = &module_;
+
+ private:
+  ADC_Module module_;
+};
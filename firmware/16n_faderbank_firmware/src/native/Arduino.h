@@ -0,0 +1,130 @@
+#pragma once
+/*
+ * Host stand-in for the parts of the Teensy core the firmware uses
+ */
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+using byte = uint8_t;
+
+constexpr uint8_t LOW = 0;
+constexpr uint8_t HIGH = 1;
+constexpr uint8_t INPUT = 0;
+constexpr uint8_t OUTPUT = 1;
+
+enum : uint8_t { A0 = 14, A1, A2, A3, A4, A5, A6, A7, A8, A9, A10, A11, A12, A13, A14, A15 };
+
+// the DWT cycle counter, counting host time at F_CPU
+#define F_CPU 96000000
+inline uint32_t arm_demcr = 0;
+inline uint32_t arm_dwt_ctrl = 0;
+uint32_t arm_dwt_cyccnt();
+#define ARM_DEMCR arm_demcr
+#define ARM_DEMCR_TRCENA (1 << 24)
+#define ARM_DWT_CTRL arm_dwt_ctrl
+#define ARM_DWT_CTRL_CYCCNTENA (1 << 0)
+#define ARM_DWT_CYCCNT arm_dwt_cyccnt()
+
+uint32_t millis();
+uint32_t micros();
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+
+// the WFI instruction: sleeps until the next interrupt, skipping simulated time ahead to it
+void wait_for_interrupt();
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+
+void noInterrupts();
+void interrupts();
+
+class Print {
+ public:
+  virtual ~Print() = default;
+  virtual size_t write(uint8_t b) = 0;
+
+  size_t print(const char* s);
+  size_t print(int n);
+  size_t println(const char* s = "");
+  size_t println(int n);
+  int printf(const char* format, ...) __attribute__((format(printf, 2, 3)));
+};
+
+/// The UART, sending at its baud rate as simulated time passes
+class HardwareSerial : public Print {
+ public:
+  static constexpr int tx_buffer_size = 64;
+
+  void begin(uint32_t baud);
+  size_t write(uint8_t b) override;
+  int availableForWrite();
+  int available();
+  int read();
+
+ private:
+  void Drain();
+
+  uint32_t byte_time_ = 320;  // us per byte at 31250 baud
+  int queued_ = 0;
+  uint64_t drained_at_ = 0;
+};
+
+class usb_serial_class : public Print {
+ public:
+  void begin(uint32_t baud);
+  size_t write(uint8_t b) override;
+};
+
+extern usb_serial_class Serial;
+extern HardwareSerial Serial1;
+
+class IntervalTimer {
+ public:
+  ~IntervalTimer();
+  bool begin(void (*function)(), uint32_t period);
+  void update(uint32_t period);
+  void end();
+
+  void (*function_)() = nullptr;
+  uint32_t period_ = 0;
+  uint64_t next_ = 0;
+};
+
+class usb_midi_class {
+ public:
+  void sendControlChange(uint8_t control, uint8_t value, uint8_t channel, uint8_t cable = 0);
+  void sendSysEx(uint32_t length, const uint8_t* data, bool has_term = false, uint8_t cable = 0);
+  void sendRealTime(uint8_t type, uint8_t cable = 0);
+  void send(uint8_t type, uint8_t data1, uint8_t data2, uint8_t channel, uint8_t cable);
+  void send_now();
+  bool read(uint8_t channel = 0);
+  uint8_t getType();
+  uint8_t getChannel();
+  uint8_t getData1();
+  uint8_t getData2();
+  uint8_t* getSysExArray();
+  uint16_t getSysExArrayLength();
+
+  void setHandleSystemExclusive(void (*handler)(uint8_t* data, size_t size));
+  void setHandleSystemExclusive(void (*handler)(const uint8_t* data, uint16_t length, bool complete));
+
+  void (*sysex_handler_)(uint8_t* data, size_t size) = nullptr;
+  void (*sysex_chunk_handler_)(const uint8_t* data, uint16_t length, bool complete) = nullptr;
+
+ private:
+  std::vector<uint8_t> message_;
+  size_t sysex_at_ = 0;  // how much of a SysEx message in message_ has been handed over
+  uint8_t type_ = 0;
+  uint8_t channel_ = 0;
+  uint8_t data1_ = 0;
+  uint8_t data2_ = 0;
+};
+
+extern usb_midi_class usbMIDI;
@@ -0,0 +1,9 @@
+#pragma once
+/*
+ * Host stand-in for the CD74HC4067 mux library
+ */
+class CD74HC4067 {
+ public:
+  CD74HC4067(int s0, int s1, int s2, int s3);
+  void channel(int channel);
+};
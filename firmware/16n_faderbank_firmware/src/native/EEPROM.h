@@ -0,0 +1,18 @@
+#pragma once
+/*
+ * Host stand-in for the Teensy's emulated EEPROM
+ */
+#include <array>
+#include <cstdint>
+
+class EEPROMClass {
+ public:
+  uint8_t read(int address);
+  void write(int address, uint8_t value);
+  void update(int address, uint8_t value);
+  uint16_t length();
+
+  std::array<uint8_t, 2048> data_;
+};
+
+extern EEPROMClass EEPROM;
@@ -0,0 +1,70 @@
+/*
+ * ResponsiveAnalogRead.h
+ * Arduino library for eliminating noise in analogRead inputs without decreasing responsiveness
+ *
+ * Copyright (c) 2016 Damien Clarke
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Vendored from dxinteractive/ResponsiveAnalogRead 1.2.1, which the firmware used before FilterBank,
+ * so the host checks can compare the two. Cut down to update(int), with no pin reads,
+ * and with its state starting at zero as the firmware's global instances did.
+ */
+#pragma once
+
+class ResponsiveAnalogRead {
+ public:
+  ResponsiveAnalogRead() {}
+  ResponsiveAnalogRead(bool sleepEnable, float snapMultiplier = 0.01);
+
+  inline int getValue() { return responsiveValue; }
+  inline int getRawValue() { return rawValue; }
+  inline bool hasChanged() { return responsiveValueHasChanged; }
+  inline bool isSleeping() { return sleeping; }
+  void update(int rawValueRead);
+
+  void setSnapMultiplier(float newMultiplier);
+  inline void enableSleep() { sleepEnable = true; }
+  inline void disableSleep() { sleepEnable = false; }
+  inline void enableEdgeSnap() { edgeSnapEnable = true; }
+  inline void disableEdgeSnap() { edgeSnapEnable = false; }
+  inline void setActivityThreshold(float newThreshold) { activityThreshold = newThreshold; }
+  inline void setAnalogResolution(int resolution) { analogResolution = resolution; }
+
+ private:
+  int analogResolution = 1024;
+  float snapMultiplier = 0.01;
+  bool sleepEnable = false;
+  float activityThreshold = 4.0;
+  bool edgeSnapEnable = true;
+
+  float smoothValue = 0.0;
+  float errorEMA = 0.0;
+  bool sleeping = false;
+
+  int rawValue = 0;
+  int responsiveValue = 0;
+  int prevResponsiveValue = 0;
+  bool responsiveValueHasChanged = false;
+
+  int getResponsiveValue(int newValue);
+  float snapCurve(float x);
+};
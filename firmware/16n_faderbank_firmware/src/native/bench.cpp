@@ -0,0 +1,192 @@
+/*
+ * 16n Faderbank host benchmark
+ * MIT License
+ *
+ * Runs the firmware against the host stand-ins with scripted fader motion, and reports
+ * what goes out of each port and what the hot paths cost on the host.
+ */
+#include <EEPROM.h>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <functional>
+#include <random>
+#include <string_view>
+#include "configuration.hpp"
+#include "filter.hpp"
+#include "hal.hpp"
+#include "midi.hpp"
+#include "replay.hpp"
+
+void setup();
+void loop();
+
+int Check();
+
+namespace {
+
+constexpr int full_scale = 8191;      // 13 bits
+constexpr uint32_t loop_time = 5;     // us of simulated time per pass through loop()
+constexpr uint32_t run_seconds = 10;  // per motion
+
+std::mt19937 rng{16};
+
+using Clock = std::chrono::steady_clock;
+
+/// A scripted fader motion: the position of a fader at a time, before noise
+struct Motion {
+  const char* name;
+  std::function<double(int fader, double t)> position;
+  int noise;  // peak to peak, in counts
+};
+
+void SetFaders(const Motion& motion, double t) {
+  std::uniform_int_distribution<int> noise(-motion.noise / 2, motion.noise / 2);
+  for (int fader = 0; fader < kNumChannels; fader++) {
+    const int value = std::lround(motion.position(fader, t) * full_scale) + noise(rng);
+    hal::SetFader(fader, std::clamp(value, 0, full_scale));
+  }
+}
+
+void RunMotion(const Motion& motion) {
+  hal::counters = {};
+  double host_ns = 0;
+  uint64_t loops = 0;
+
+  const uint64_t end = hal::now + run_seconds * 1000000ull;
+  while (hal::now < end) {
+    SetFaders(motion, (hal::now - (end - run_seconds * 1000000ull)) / 1e6);
+
+    const auto started = Clock::now();
+    loop();
+    host_ns += std::chrono::duration<double, std::nano>(Clock::now() - started).count();
+    loops++;
+
+    hal::Advance(loop_time);
+  }
+
+  const auto& c = hal::counters;
+  printf("%-12s %10.1f %10.1f %10.1f %10.1f %10u %10.1f\n", motion.name, c.usb_messages / double(run_seconds),
+         c.usb_flushes / double(run_seconds), c.trs_bytes / double(run_seconds),
+         c.i2c_transfers / double(run_seconds), c.trs_stalls, host_ns / loops);
+}
+
+/*
+ * Times a function over a number of runs, in host nanoseconds per run
+ */
+double Time(int runs, const std::function<void(int)>& function) {
+  const auto started = Clock::now();
+  for (int i = 0; i < runs; i++) {
+    function(i);
+  }
+  return std::chrono::duration<double, std::nano>(Clock::now() - started).count() / runs;
+}
+
+/// Counts controller messages without sending them anywhere
+struct NullPort {
+  uint32_t bytes = 0;
+  void sendControlChange(uint8_t control, uint8_t value, uint8_t) {
+    bytes += 3 + control + value;
+  }
+};
+
+void RunMicro() {
+  constexpr int runs = 1000000;
+
+  std::vector<FilterBank::Values> frames(1024);
+  std::uniform_int_distribution<int> sample(0, full_scale);
+  for (auto& frame : frames) {
+    for (auto& value : frame) {
+      value = sample(rng);
+    }
+  }
+
+  volatile uint32_t sink = 0;
+
+  for (auto mode : {Config::FilterMode::RESPONSIVE, Config::FilterMode::ADAPTIVE}) {
+    Config filter_config = config;
+    filter_config.filter_mode = mode;
+
+    FilterBank bank;
+    bank.Setup(1 << 13, 32, .0001);
+    bank.Configure(filter_config);
+
+    const double ns = Time(runs / 16, [&](int i) { sink = sink + bank.Update(frames[i % frames.size()]); });
+    printf("FilterBank::Update (%-10s)  %8.1f ns/frame\n", mode == Config::FilterMode::ADAPTIVE ? "adaptive" : "responsive",
+           ns);
+  }
+
+  const double map_ns = Time(runs, [&](int i) {
+    sink = sink + config.calibrations[i % kNumChannels].Map(frames[0][i % kNumChannels] + i % 7);
+  });
+  printf("Calibration::Map                 %8.1f ns/value\n", map_ns);
+
+  NullPort port;
+  for (auto resolution : {Config::Resolution::CC_7BIT, Config::Resolution::CC_14BIT, Config::Resolution::NRPN}) {
+    const double ns = Time(runs, [&](int i) { MIDI::SendControl(port, resolution, i % 32, i & 0x3FFF, 1); });
+    printf("MIDI::SendControl (%d bytes)     %8.1f ns/value\n", MIDI::MessageSize(resolution), ns);
+  }
+  sink = sink + port.bytes;
+
+  // SysEx as the editor sends it, put back together from the core's chunks: a whole config edit,
+  // which is loaded, and a usb edit one byte short, which is turned away
+  std::vector<uint8_t> edit = {0xF0, 0x7D, 0x00, 0x00, 0x0E, 0x00, 0x00, 0x00, 0x00};
+  edit.insert(edit.end(), config.image.begin(), config.image.end());
+  edit.push_back(0xF7);
+
+  std::vector<uint8_t> short_edit = {0xF0, 0x7D, 0x00, 0x00, 0x0C};
+  short_edit.insert(short_edit.end(), 2 * Config::MIDI_CONFIG_SIZE - 1, 0x01);
+  short_edit.push_back(0xF7);
+
+  for (const auto* message : {&edit, &short_edit}) {
+    const double ns = Time(runs / 1000, [&](int) { hal::ReceiveSysEx(*message); });
+    printf("sysex::Receive (%3zu bytes)       %8.1f ns/byte\n", message->size(), ns / message->size());
+  }
+}
+}  // namespace
+
+int main(int argc, char** argv) {
+  // boot as an i2c leader with one of each follower on the bus
+  config.FactoryReset();
+  config.image[Config::I2C_MASTER] = 1;
+  for (size_t i = 0; i < config.image.size(); i++) {
+    EEPROM.write(i, config.image[i]);
+  }
+  hal::i2c_followers = {0x60, 0x31, 0x20};
+
+  setup();
+
+  if (argc == 3 && std::string_view(argv[1]) == "replay") {
+    ReplayResult result;
+    return Replay(argv[2], result) ? 0 : 1;
+  }
+  if (argc == 2 && std::string_view(argv[1]) == "check") {
+    return Check();
+  }
+
+  const std::array<Motion, 4> motions = {{
+      {"rest", [](int, double) { return 0.5; }, 8},
+      {"slow sweep", [](int, double t) { return t / run_seconds; }, 4},
+      {"all sine", [](int fader, double t) { return 0.5 + 0.5 * std::sin(2 * M_PI * (0.5 * t + fader / 16.0)); }, 4},
+      {"fast throws",
+       [](int fader, double t) { return std::fmod(std::floor(t * 4) + fader, 2) < 1 ? 0.02 : 0.98; }, 4},
+  }};
+
+  // let discovery and the filters settle where the first motion starts, so it doesn't begin with a move
+  for (int i = 0; i < 200000; i++) {
+    SetFaders(motions[0], 0);
+    loop();
+    hal::Advance(loop_time);
+  }
+
+  printf("per simulated second, %us each\n", run_seconds);
+  printf("%-12s %10s %10s %10s %10s %10s %10s\n", "motion", "usb msgs", "usb flush", "trs bytes", "i2c xfers",
+         "trs stalls", "ns/loop");
+  for (const auto& motion : motions) {
+    RunMotion(motion);
+  }
+
+  printf("\n");
+  RunMicro();
+  return 0;
+}
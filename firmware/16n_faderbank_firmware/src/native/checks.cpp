@@ -0,0 +1,442 @@
+/*
+ * 16n Faderbank host checks
+ * MIT License
+ *
+ * Checks of the firmware against references and invariants, run with `program check`.
+ * Each prints what it measured and returns whether it held.
+ */
+#include <sys/time.h>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <csignal>
+#include <cstdio>
+#include <random>
+#include "ResponsiveAnalogRead.h"
+#include "config.h"
+#include "configuration.hpp"
+#include "filter.hpp"
+#include "hal.hpp"
+#include "i2c.hpp"
+#include "replay.hpp"
+#include "scan.hpp"
+#include "state.hpp"
+#include "sysex.hpp"
+
+namespace {
+
+constexpr int full_scale = 8191;  // 13 bits
+
+// how far the filter bank's output may be from ResponsiveAnalogRead's, in counts
+constexpr int filter_tolerance = 1;
+
+// and how far apart the number of times each reports a change may be
+constexpr double change_tolerance = 0.01;  // 1%
+
+/*
+ * Runs scripted motion with noise through FilterBank's responsive mode and through ResponsiveAnalogRead,
+ * set up as the firmware used to, and compares them frame by frame.
+ */
+bool CheckResponsiveFilter() {
+  std::mt19937 rng{7};
+  std::uniform_int_distribution noise(-4, 4);
+
+  // a few seconds of each, one fader per motion and a couple resting at the ends
+  const auto position = [](int fader, double t) {
+    switch (fader % 8) {
+      case 0: return 0.5;
+      case 1: return t / 8;
+      case 2: return 0.5 + 0.5 * std::sin(2 * M_PI * 0.5 * t);
+      case 3: return std::fmod(std::floor(t * 4), 2) < 1 ? 0.02 : 0.98;
+      case 4: return 0.0;
+      case 5: return 1.0;
+      case 6: return 0.5 + 0.4 * std::sin(2 * M_PI * 3 * t);
+      default: return std::fmod(t, 2) < 1 ? 0.3 : 0.3 + 0.001 * std::floor(std::fmod(t, 1) * 50);
+    }
+  };
+
+  FilterBank bank;
+  bank.Setup(full_scale + 1, 32, .0001);
+
+  std::array<ResponsiveAnalogRead, kNumChannels> reference;
+  for (auto& reader : reference) {
+    reader = ResponsiveAnalogRead(true, .0001);
+    reader.setAnalogResolution(full_scale + 1);
+    reader.setActivityThreshold(32);
+  }
+
+  const int frames = 8 * 1000000 / scan::frame_interval;
+  int worst = 0;
+  uint32_t differing = 0;
+  uint32_t bank_changes = 0;
+  uint32_t reference_changes = 0;
+  for (int f = 0; f < frames; f++) {
+    const double t = f * scan::frame_interval / 1e6;
+
+    FilterBank::Values raw;
+    for (int c = 0; c < kNumChannels; c++) {
+      raw[c] = std::clamp<int>(std::lround(position(c, t) * full_scale) + noise(rng), 0, full_scale);
+    }
+
+    const uint16_t changed = bank.Update(raw);
+    for (int c = 0; c < kNumChannels; c++) {
+      reference[c].update(raw[c]);
+      bank_changes += (changed >> c) & 1;
+      reference_changes += reference[c].hasChanged();
+
+      const int difference = std::abs(bank.value(c) - reference[c].getValue());
+      worst = std::max(worst, difference);
+      differing += difference != 0;
+    }
+  }
+
+  const bool held = worst <= filter_tolerance &&
+                    std::abs(1.0 * bank_changes - reference_changes) <= change_tolerance * reference_changes;
+  printf("%s responsive filter against ResponsiveAnalogRead: worst %d counts (tolerance %d), %.3f%% of values "
+         "differ, %u changes against %u\n",
+         held ? "ok  " : "FAIL", worst, filter_tolerance, 100.0 * differing / (frames * kNumChannels), bank_changes,
+         reference_changes);
+  return held;
+}
+
+/// The most a replayed trace may show, beyond which it has regressed
+struct ReplayLimits {
+  const char* path;  // from the directory the program runs in
+  double p50;        // ms
+  double p90;        // ms
+  double p99;        // ms
+  size_t min_moves;  // fewer means movement is being lost
+  uint32_t reversals;
+  uint32_t unprompted;
+};
+
+// each trace's limits sit a little above what it does now
+constexpr ReplayLimits replay_limits[] = {
+    {"traces/modelled.trace", 3, 16, 75, 290, 2, 2},
+};
+
+/*
+ * Replays the traces in traces/, failing any that goes past its limits
+ */
+bool CheckReplay() {
+  bool held = true;
+  for (const auto& limits : replay_limits) {
+    ReplayResult result;
+    if (!Replay(limits.path, result)) {
+      printf("FAIL replay of %s: no trace\n", limits.path);
+      held = false;
+      continue;
+    }
+
+    const bool ok = result.p50 <= limits.p50 && result.p90 <= limits.p90 && result.p99 <= limits.p99 &&
+                    result.moves >= limits.min_moves && result.reversals <= limits.reversals &&
+                    result.unprompted <= limits.unprompted;
+    printf("%s replay of %s: latency p50/p90/p99 %.2f/%.2f/%.2fms (limits %.0f/%.0f/%.0f), %zu moves (at least %zu), "
+           "%u reversed (at most %u), %u unprompted (at most %u)\n",
+           ok ? "ok  " : "FAIL", limits.path, result.p50, result.p90, result.p99, limits.p50, limits.p90, limits.p99,
+           result.moves, limits.min_moves, result.reversals, limits.reversals, result.unprompted, limits.unprompted);
+    held &= ok;
+  }
+  return held;
+}
+
+// how long to publish frames for while a timer signal reads them, in host time
+constexpr auto publish_time = std::chrono::milliseconds(500);
+constexpr int read_interval = 7;  // us
+
+// frame k has fader c at (k + c), so any read can be traced back to the one frame it came from, or not
+constexpr uint16_t FrameValue(uint32_t k, size_t c) {
+  return (k + c) & 0x3FFF;
+}
+
+// written by the main thread, and read by the signal handler standing in for the i2c interrupt
+volatile std::sig_atomic_t publishing = 0;
+std::atomic<uint32_t> last_published{0};
+
+// the handler's tally
+volatile uint32_t reads = 0;
+volatile uint32_t torn = 0;
+volatile uint32_t stale = 0;
+volatile uint32_t during_publish = 0;
+
+/*
+ * A leader's transaction: a read command, then the read. Takes turns between reading every fader,
+ * a range of them and the changed ones, and checks the answer is all from one frame that had been published.
+ */
+void LeaderTransaction(int) {
+  const uint32_t latest = last_published.load();
+  const uint32_t n = reads;
+  reads = n + 1;
+  during_publish = during_publish + publishing;
+
+  size_t first = 0;
+  size_t count = kNumChannels;
+  bool changed = false;
+  switch (n % 3) {
+    case 0:
+      hal::LeaderWrite({i2c::commands::read_all, 0});
+      break;
+    case 1:
+      first = n % kNumChannels;
+      count = kNumChannels - first;
+      hal::LeaderWrite({i2c::commands::read_range, static_cast<uint8_t>(first), 0, static_cast<uint8_t>(count)});
+      break;
+    default:
+      changed = true;
+      hal::LeaderWrite({i2c::commands::read_changed, 0});
+      break;
+  }
+  const std::vector<uint8_t> answer = hal::LeaderRead();
+
+  std::array<uint16_t, 1 + kNumChannels> values{};
+  for (size_t i = 0; i + 1 < answer.size() && i / 2 < values.size(); i += 2) {
+    values[i / 2] = (answer[i] << 8) | answer[i + 1];
+  }
+
+  // every frame moves every fader, so a read of changes is all of them or none
+  size_t at = 0;
+  if (changed) {
+    if (values[0] == 0 && answer.size() == 2) {
+      return;
+    }
+    if (values[0] != 0xFFFF) {
+      torn = torn + 1;
+      return;
+    }
+    at = 1;
+  }
+
+  if (answer.size() != 2 * (at + count)) {
+    torn = torn + 1;
+    return;
+  }
+
+  // the frame published last, or the one being published as we interrupted it
+  const uint32_t k = values[at] - first;
+  for (size_t c = 0; c < count; c++) {
+    if (values[at + c] != FrameValue(k, first + c)) {
+      torn = torn + 1;
+      return;
+    }
+  }
+  if (((k - latest) & 0x3FFF) > 1) {
+    stale = stale + 1;
+  }
+}
+
+/*
+ * Publishes frame after frame as a follower, with a timer signal standing in for the i2c interrupt:
+ * it lands anywhere in the main thread, including halfway through Publish(), and the main thread
+ * doesn't run again until it's done, as on the Teensy. Every read has to be one whole published frame.
+ */
+bool CheckFollowerReads() {
+  // the mode is only read at startup, so it's switched here rather than through the config block
+  const bool leader = config.i2c_master;
+  config.i2c_master = false;
+  i2c::Setup();
+
+  uint32_t k = 1;
+  for (size_t c = 0; c < kNumChannels; c++) {
+    state.current[c] = FrameValue(k, c);
+  }
+  i2c::Publish();
+  last_published = k;
+
+  std::signal(SIGALRM, LeaderTransaction);
+  const itimerval interval = {{0, read_interval}, {0, read_interval}};
+  setitimer(ITIMER_REAL, &interval, nullptr);
+
+  const auto until = std::chrono::steady_clock::now() + publish_time;
+  while (std::chrono::steady_clock::now() < until) {
+    for (int i = 0; i < 1000; i++) {
+      k++;
+      for (size_t c = 0; c < kNumChannels; c++) {
+        state.current[c] = FrameValue(k, c);
+      }
+      publishing = 1;
+      i2c::Publish();
+      publishing = 0;
+      last_published = k;
+    }
+  }
+
+  const itimerval stop = {};
+  setitimer(ITIMER_REAL, &stop, nullptr);
+  std::signal(SIGALRM, SIG_DFL);
+
+  config.i2c_master = leader;
+  i2c::Setup();
+
+  const bool held = torn == 0 && stale == 0 && during_publish > 0;
+  printf("%s follower reads against Publish(): %u reads, %u of them during a Publish(), over %u frames; "
+         "%u not one whole frame, %u not the latest\n",
+         held ? "ok  " : "FAIL", reads, during_publish, k, torn, stale);
+  return held;
+}
+
+constexpr uint32_t fuzz_rounds = 20000;
+
+/*
+ * Something for sysex::Receive: random bytes, or a message of ours of a random type and length,
+ * sometimes with a byte or two changed, sometimes cut off or run together with the next
+ */
+std::vector<uint8_t> FuzzStream(std::mt19937& rng) {
+  std::vector<uint8_t> stream;
+  const int messages = std::uniform_int_distribution(1, 3)(rng);
+  for (int m = 0; m < messages; m++) {
+    const uint32_t kind = rng() % 4;
+    if (kind == 0) {
+      const size_t length = rng() % 64;
+      for (size_t i = 0; i < length; i++) {
+        stream.push_back(rng());
+      }
+      continue;
+    }
+
+    // lengths around what each type takes, and now and then far longer than anything does
+    constexpr std::array<uint8_t, 14> types = {0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x15, 0x16,
+                                               0x17, 0x1A, 0x1B, 0x1C, 0x1F, 0x00, 0x7F};
+    const size_t sizes[] = {0, 1, 2, 16, 32, 80, 84, 84 + Config::SIZE / 2, 4 + Config::SIZE, 5 + Config::SIZE, 2000};
+    size_t length = sizes[rng() % std::size(sizes)];
+    length += std::uniform_int_distribution(-1, 1)(rng) * (length > 0);
+
+    stream.insert(stream.end(), {0xF0, 0x7D, 0x00, 0x00, types[rng() % types.size()]});
+    for (size_t i = 0; i < length; i++) {
+      stream.push_back(rng() & 0x7F);
+    }
+    if (kind != 1) {
+      stream.push_back(0xF7);
+    }
+    if (kind == 3) {
+      stream[std::uniform_int_distribution<size_t>(0, stream.size() - 1)(rng)] = rng();
+    }
+  }
+  return stream;
+}
+
+/*
+ * Hands a stream to sysex::Receive in random chunks. Most often the last one is marked complete,
+ * and now and then one in the middle, as a core that ends a message early might; otherwise
+ * the stream is left unfinished, as if the cable was pulled.
+ */
+void ReceiveInChunks(std::mt19937& rng, const std::vector<uint8_t>& stream) {
+  const bool finished = rng() % 4 != 0;
+  size_t at = 0;
+  do {
+    const size_t length = std::min<size_t>(rng() % 80, stream.size() - at);
+    const bool complete = (at + length == stream.size() && finished) || rng() % 16 == 0;
+    sysex::Receive(stream.data() + at, length, complete);
+    at += length;
+  } while (at < stream.size());
+}
+
+/*
+ * Feeds sysex::Receive random streams in random chunks. Each is followed by a filter edit with a new value,
+ * whole but also in random chunks, which has to land whatever came before it.
+ * Run under a sanitizer to catch anything that reads or writes out of bounds on the way.
+ */
+bool CheckSysexFuzz() {
+  const Config::Image saved = config.image;
+  std::mt19937 rng{23};
+  uint32_t lost = 0;
+  for (uint32_t round = 0; round < fuzz_rounds; round++) {
+    ReceiveInChunks(rng, FuzzStream(rng));
+
+    const uint8_t cutoff = 1 + round % 127;
+    std::vector<uint8_t> edit = {0xF0, 0x7D, 0x00, 0x00, 0x0A};
+    edit.resize(edit.size() + Config::FILTER_CONFIG_SIZE);
+    edit[5 + 1] = cutoff;
+    edit.push_back(0xF7);
+
+    size_t at = 0;
+    while (at < edit.size()) {
+      const size_t length = std::min<size_t>(1 + rng() % 12, edit.size() - at);
+      sysex::Receive(edit.data() + at, length, at + length == edit.size());
+      at += length;
+    }
+
+    if (config.filter_min_cutoff != cutoff) {
+      if (!lost) {
+        printf("     round %u: the filter edit after a fuzzed stream didn't land\n", round);
+      }
+      lost++;
+    }
+  }
+
+  config.Edit(0, saved);
+  config.Load();
+  filters.Configure(config);
+
+  const bool held = lost == 0;
+  printf("%s sysex::Receive fuzzing: %u random streams in random chunks, %u edits after them lost\n",
+         held ? "ok  " : "FAIL", fuzz_rounds, lost);
+  return held;
+}
+
+// how many Commit() calls a commit of a couple of bytes takes, with room to spare
+constexpr size_t commit_steps = 8;
+
+/*
+ * Commits the config until nothing is left unsaved, the way the main loop does
+ */
+void CommitAll() {
+  for (size_t i = 0; i < 1000 && config.dirty(); i++) {
+    hal::Advance(1000);
+    config.Commit();
+  }
+}
+
+/*
+ * Interrupts a commit with an edit after every number of steps, to a byte it has already written
+ * and to one it never had to, then power cycles. What boots has to be the config with both edits.
+ */
+bool CheckInterruptedCommit() {
+  const Config::Image saved = config.image;
+  CommitAll();
+
+  uint32_t runs = 0;
+  uint32_t lost = 0;
+  for (size_t steps = 0; steps < commit_steps; steps++) {
+    for (const int interrupted : {Config::LED_POWER, Config::ROTATE}) {
+      const uint8_t led_power = config.image[Config::LED_POWER] ^ 1;
+      const uint8_t edit = config.image[interrupted] ^ (interrupted == Config::LED_POWER ? 3 : 1);
+      config.Edit(Config::LED_POWER, std::array{led_power});
+      hal::Advance(1000000);
+      for (size_t i = 0; i < steps; i++) {
+        config.Commit();
+      }
+      config.Edit(interrupted, std::array{edit});
+      CommitAll();
+
+      Config rebooted;
+      rebooted.Check();
+      runs++;
+      if (rebooted.image != config.image) {
+        if (!lost) {
+          printf("     an edit %zu steps into a commit was lost at the next boot\n", steps);
+        }
+        lost++;
+      }
+    }
+  }
+
+  config.Edit(0, saved);
+  CommitAll();
+  config.Load();
+
+  const bool held = lost == 0;
+  printf("%s commits interrupted by an edit, then power cycled: %u runs, %u came back without the edit\n",
+         held ? "ok  " : "FAIL", runs, lost);
+  return held;
+}
+}  // namespace
+
+int Check() {
+  bool held = true;
+  held &= CheckResponsiveFilter();
+  held &= CheckReplay();
+  held &= CheckFollowerReads();
+  held &= CheckSysexFuzz();
+  held &= CheckInterruptedCommit();
+  return held ? 0 : 1;
+}
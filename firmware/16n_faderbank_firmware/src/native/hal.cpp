@@ -0,0 +1,526 @@
+/*
+ * 16n Faderbank host stand-ins for the Teensy core and libraries
+ * MIT License
+ */
+#include "hal.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdarg>
+#include "ADC.h"
+#include "Arduino.h"
+#include "CD74HC4067.h"
+#include "EEPROM.h"
+#include "i2c_t3.h"
+
+namespace hal {
+uint64_t now = 0;
+std::array<uint16_t, 16> mux_inputs{};
+std::set<uint8_t> i2c_followers;
+Counters counters;
+bool record_usb = false;
+std::vector<UsbMessage> usb_log;
+std::vector<uint8_t> last_sysex;
+bool record_trs = false;
+std::vector<uint8_t> trs_log;
+std::deque<std::vector<uint8_t>> usb_inbound;
+std::deque<uint8_t> trs_inbound;
+
+// everything that can interrupt. Never destroyed, the firmware's timers end themselves at exit after it would be.
+static std::vector<IntervalTimer*>& timers = *new std::vector<IntervalTimer*>;
+static std::vector<ADC_Module*> adcs;
+static int mux_channel = 0;
+
+// how much SysEx the Teensy 3 core buffers before handing it over, USB_MIDI_SYSEX_MAX
+constexpr size_t sysex_chunk_size = 290;
+
+void Advance(uint32_t us) {
+  const uint64_t end = now + us;
+
+  while (true) {
+    // find whichever interrupt is due first
+    uint64_t next = end + 1;
+    IntervalTimer* timer = nullptr;
+    ADC_Module* adc = nullptr;
+
+    for (auto* t : timers) {
+      if (t->next_ < next) {
+        next = t->next_;
+        timer = t;
+      }
+    }
+    for (auto* a : adcs) {
+      if (a->done_at_ < next) {
+        next = a->done_at_;
+        timer = nullptr;
+        adc = a;
+      }
+    }
+
+    if (next > end) {
+      break;
+    }
+
+    now = next;
+    if (adc) {
+      adc->done_at_ = UINT64_MAX;
+      if (adc->isr_) {
+        adc->isr_();
+      }
+    }
+    else {
+      timer->next_ += timer->period_;
+      timer->function_();
+    }
+  }
+
+  now = end;
+}
+
+void SetFader(int fader, uint16_t value) {
+  // the mux input each fader is wired to, as in scan.cpp
+  constexpr std::array mux_map = {0, 1, 2, 3, 4, 5, 6, 7, 15, 14, 13, 12, 11, 10, 9, 8};
+  mux_inputs[mux_map[fader]] = value;
+}
+
+/*
+ * Hands SysEx to whichever handler the firmware installed, the way the core does:
+ * in chunks to the 3 argument one, or whole to the other
+ */
+void DeliverSysEx(std::vector<uint8_t> sysex) {
+  if (usbMIDI.sysex_chunk_handler_) {
+    for (size_t at = 0; at < sysex.size(); at += sysex_chunk_size) {
+      const size_t length = std::min(sysex_chunk_size, sysex.size() - at);
+      usbMIDI.sysex_chunk_handler_(sysex.data() + at, length, at + length == sysex.size());
+    }
+  }
+  else if (usbMIDI.sysex_handler_) {
+    usbMIDI.sysex_handler_(sysex.data(), sysex.size());
+  }
+}
+
+void ReceiveSysEx(const std::vector<uint8_t>& sysex) {
+  DeliverSysEx(sysex);
+}
+
+void LeaderWrite(const std::vector<uint8_t>& data) {
+  i2c_t3& bus = Wire.receive_handler_ ? Wire : Wire1;
+  std::copy_n(data.begin(), std::min(data.size(), bus.rx_buffer_.size()), bus.rx_buffer_.begin());
+  bus.rx_length_ = std::min(data.size(), bus.rx_buffer_.size());
+  bus.rx_position_ = 0;
+  if (bus.receive_handler_) {
+    bus.receive_handler_(bus.rx_length_);
+  }
+}
+
+std::vector<uint8_t> LeaderRead() {
+  i2c_t3& bus = Wire.request_handler_ ? Wire : Wire1;
+  bus.tx_length_ = 0;
+  if (bus.request_handler_) {
+    bus.request_handler_();
+  }
+  return {bus.tx_buffer_.begin(), bus.tx_buffer_.begin() + bus.tx_length_};
+}
+}  // namespace hal
+
+// core
+
+uint32_t arm_dwt_cyccnt() {
+  const auto ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now().time_since_epoch());
+  return static_cast<uint64_t>(ns.count() * (F_CPU / 1e9));
+}
+
+uint32_t millis() {
+  return hal::now / 1000;
+}
+
+uint32_t micros() {
+  return hal::now;
+}
+
+void delay(uint32_t ms) {
+  hal::Advance(ms * 1000);
+}
+
+void delayMicroseconds(uint32_t us) {
+  hal::Advance(us);
+}
+
+void wait_for_interrupt() {
+  // anything waiting to be read has already interrupted
+  if (!hal::usb_inbound.empty() || !hal::trs_inbound.empty()) {
+    return;
+  }
+
+  // the next timer or conversion, or the 1ms tick, whichever comes first
+  uint64_t next = (hal::now / 1000 + 1) * 1000;
+  for (auto* timer : hal::timers) {
+    next = std::min(next, timer->next_);
+  }
+  for (auto* adc : hal::adcs) {
+    next = std::min(next, adc->done_at_);
+  }
+  hal::Advance(next - hal::now);
+}
+
+void pinMode(uint8_t, uint8_t) {
+}
+
+void digitalWrite(uint8_t, uint8_t) {
+}
+
+void noInterrupts() {
+}
+
+void interrupts() {
+}
+
+size_t Print::print(const char* s) {
+  size_t n = 0;
+  while (*s) {
+    n += write(*s++);
+  }
+  return n;
+}
+
+size_t Print::print(int n) {
+  return printf("%d", n);
+}
+
+size_t Print::println(const char* s) {
+  return print(s) + write('\n');
+}
+
+size_t Print::println(int n) {
+  return print(n) + write('\n');
+}
+
+int Print::printf(const char* format, ...) {
+  char buffer[256];
+  va_list args;
+  va_start(args, format);
+  const int length = vsnprintf(buffer, sizeof(buffer), format, args);
+  va_end(args);
+  print(buffer);
+  return length;
+}
+
+usb_serial_class Serial;
+HardwareSerial Serial1;
+
+void usb_serial_class::begin(uint32_t) {
+}
+
+size_t usb_serial_class::write(uint8_t b) {
+  putchar(b);
+  return 1;
+}
+
+void HardwareSerial::begin(uint32_t baud) {
+  byte_time_ = 10000000 / baud;  // start + 8 data + stop bits
+  queued_ = 0;
+  drained_at_ = hal::now;
+}
+
+void HardwareSerial::Drain() {
+  const int sent = std::min<uint64_t>((hal::now - drained_at_) / byte_time_, queued_);
+  queued_ -= sent;
+  drained_at_ = queued_ ? drained_at_ + sent * byte_time_ : hal::now;
+}
+
+int HardwareSerial::availableForWrite() {
+  Drain();
+  return tx_buffer_size - queued_;
+}
+
+size_t HardwareSerial::write(uint8_t b) {
+  Drain();
+  if (queued_ == tx_buffer_size) {
+    // the real thing blocks here until the TX interrupt makes room
+    hal::counters.trs_stalls++;
+    hal::Advance(drained_at_ + byte_time_ - hal::now);
+    Drain();
+  }
+  queued_++;
+  hal::counters.trs_bytes++;
+  if (hal::record_trs) {
+    hal::trs_log.push_back(b);
+  }
+  return 1;
+}
+
+int HardwareSerial::available() {
+  return hal::trs_inbound.size();
+}
+
+int HardwareSerial::read() {
+  if (hal::trs_inbound.empty()) {
+    return -1;
+  }
+  const uint8_t b = hal::trs_inbound.front();
+  hal::trs_inbound.pop_front();
+  return b;
+}
+
+IntervalTimer::~IntervalTimer() {
+  end();
+}
+
+bool IntervalTimer::begin(void (*function)(), uint32_t period) {
+  end();
+  function_ = function;
+  period_ = period;
+  next_ = hal::now + period;
+  hal::timers.push_back(this);
+  return true;
+}
+
+void IntervalTimer::update(uint32_t period) {
+  period_ = period;
+}
+
+void IntervalTimer::end() {
+  std::erase(hal::timers, this);
+}
+
+usb_midi_class usbMIDI;
+
+void usb_midi_class::sendControlChange(uint8_t control, uint8_t value, uint8_t channel, uint8_t) {
+  send(0xB0, control, value, channel, 0);
+}
+
+void usb_midi_class::send(uint8_t type, uint8_t data1, uint8_t data2, uint8_t channel, uint8_t) {
+  hal::counters.usb_messages++;
+  if (hal::record_usb) {
+    const uint8_t status = type < 0xF0 ? type | ((channel - 1) & 0x0F) : type;
+    hal::usb_log.push_back({hal::now, status, data1, data2});
+  }
+}
+
+void usb_midi_class::sendSysEx(uint32_t length, const uint8_t* data, bool, uint8_t) {
+  hal::counters.usb_sysex++;
+  hal::last_sysex.assign(data, data + length);
+}
+
+void usb_midi_class::sendRealTime(uint8_t type, uint8_t) {
+  send(type, 0, 0, 0, 0);
+}
+
+void usb_midi_class::send_now() {
+  hal::counters.usb_flushes++;
+}
+
+bool usb_midi_class::read(uint8_t) {
+  // SysEx goes to the chunk handler a chunk per read, the way the core hands it over as its buffer fills.
+  // Only the read that hands over the last chunk has a message to read.
+  if (sysex_chunk_handler_ && sysex_at_ < message_.size()) {
+    const size_t length = std::min(hal::sysex_chunk_size, message_.size() - sysex_at_);
+    sysex_at_ += length;
+    sysex_chunk_handler_(message_.data() + sysex_at_ - length, length, sysex_at_ == message_.size());
+    return sysex_at_ == message_.size();
+  }
+
+  if (hal::usb_inbound.empty()) {
+    return false;
+  }
+
+  // decoded the way the Teensy core does: type without the channel, channel from 1
+  message_ = hal::usb_inbound.front();
+  hal::usb_inbound.pop_front();
+  sysex_at_ = message_.size();
+  const uint8_t status = message_[0];
+  type_ = status < 0xF0 ? status & 0xF0 : status;
+  channel_ = status < 0xF0 ? (status & 0x0F) + 1 : 0;
+  data1_ = message_.size() > 1 && status != 0xF0 ? message_[1] : 0;
+  data2_ = message_.size() > 2 && status != 0xF0 ? message_[2] : 0;
+
+  if (type_ == 0xF0) {
+    if (sysex_chunk_handler_) {
+      sysex_at_ = 0;
+      return read();
+    }
+    hal::DeliverSysEx(message_);
+  }
+  return true;
+}
+
+uint8_t usb_midi_class::getType() {
+  return type_;
+}
+
+uint8_t usb_midi_class::getChannel() {
+  return channel_;
+}
+
+uint8_t usb_midi_class::getData1() {
+  return data1_;
+}
+
+uint8_t usb_midi_class::getData2() {
+  return data2_;
+}
+
+uint8_t* usb_midi_class::getSysExArray() {
+  return message_.data();
+}
+
+uint16_t usb_midi_class::getSysExArrayLength() {
+  return message_.size();
+}
+
+void usb_midi_class::setHandleSystemExclusive(void (*handler)(uint8_t*, size_t)) {
+  sysex_handler_ = handler;
+}
+
+void usb_midi_class::setHandleSystemExclusive(void (*handler)(const uint8_t*, uint16_t, bool)) {
+  sysex_chunk_handler_ = handler;
+}
+
+// EEPROM
+
+EEPROMClass EEPROM = [] {
+  EEPROMClass eeprom;
+  eeprom.data_.fill(0xFF);  // as it comes from the factory
+  return eeprom;
+}();
+
+uint8_t EEPROMClass::read(int address) {
+  return data_[address];
+}
+
+void EEPROMClass::write(int address, uint8_t value) {
+  hal::counters.eeprom_writes++;
+  data_[address] = value;
+}
+
+void EEPROMClass::update(int address, uint8_t value) {
+  if (data_[address] != value) {
+    write(address, value);
+  }
+}
+
+uint16_t EEPROMClass::length() {
+  return data_.size();
+}
+
+// CD74HC4067
+
+CD74HC4067::CD74HC4067(int, int, int, int) {
+}
+
+void CD74HC4067::channel(int channel) {
+  hal::mux_channel = channel;
+}
+
+// ADC
+
+void ADC_Module::setResolution(uint8_t) {
+}
+
+void ADC_Module::setAveraging(uint8_t) {
+}
+
+bool ADC_Module::startSingleRead(uint8_t pin) {
+  pin_ = pin;
+  done_at_ = hal::now + conversion_time;
+  return true;
+}
+
+int ADC_Module::readSingle() {
+  // 13 bits of signal in the 16 bit result
+  return hal::mux_inputs[hal::mux_channel] << 3;
+}
+
+void ADC_Module::enableInterrupts(void (*isr)(), uint8_t) {
+  isr_ = isr;
+  hal::adcs.push_back(this);
+}
+
+void ADC_Module::disableInterrupts() {
+  std::erase(hal::adcs, this);
+}
+
+// i2c_t3
+
+i2c_t3 Wire;
+i2c_t3 Wire1;
+
+// 9 bits per byte at 400kHz
+constexpr uint32_t i2c_byte_time = 23;
+
+void i2c_t3::begin() {
+}
+
+void i2c_t3::begin(i2c_mode, uint8_t, i2c_pins, i2c_pullup, uint32_t) {
+}
+
+void i2c_t3::setDefaultTimeout(uint32_t) {
+}
+
+void i2c_t3::resetBus() {
+  status_ = I2C_TIMEOUT;
+  done_at_ = hal::now;
+}
+
+void i2c_t3::beginTransmission(uint8_t address) {
+  address_ = address;
+  length_ = 0;
+}
+
+uint8_t i2c_t3::endTransmission(i2c_stop stop) {
+  sendTransmission(stop);
+  hal::Advance(done_at_ - hal::now);
+  done();
+  return status_ == I2C_WAITING ? 0 : 2;
+}
+
+void i2c_t3::sendTransmission(i2c_stop) {
+  hal::counters.i2c_transfers++;
+  status_ = I2C_SENDING;
+  done_at_ = hal::now + (1 + length_) * i2c_byte_time;
+}
+
+uint8_t i2c_t3::done() {
+  if (status_ == I2C_SENDING && hal::now >= done_at_) {
+    const bool answered = hal::i2c_followers.contains(address_);
+    status_ = answered ? I2C_WAITING : I2C_ADDR_NAK;
+    hal::counters.i2c_naks += !answered;
+  }
+  return status_ != I2C_SENDING;
+}
+
+i2c_status i2c_t3::status() {
+  done();
+  return status_;
+}
+
+size_t i2c_t3::write(uint8_t data) {
+  if (tx_length_ < tx_buffer_.size()) {
+    tx_buffer_[tx_length_++] = data;
+  }
+  length_++;
+  return 1;
+}
+
+size_t i2c_t3::write(const uint8_t* data, size_t length) {
+  for (size_t i = 0; i < length; i++) {
+    write(data[i]);
+  }
+  return length;
+}
+
+int i2c_t3::available() {
+  return rx_length_ - rx_position_;
+}
+
+int i2c_t3::read() {
+  return rx_position_ < rx_length_ ? rx_buffer_[rx_position_++] : -1;
+}
+
+void i2c_t3::onReceive(void (*handler)(size_t)) {
+  receive_handler_ = handler;
+}
+
+void i2c_t3::onRequest(void (*handler)()) {
+  request_handler_ = handler;
+}
@@ -0,0 +1,81 @@
+#pragma once
+/*
+ * Controls for the host stand-ins of the Teensy core and libraries.
+ * Everything runs on simulated time, which only moves when Advance() is called;
+ * timer and ADC interrupts fire from inside Advance(), in time order.
+ */
+#include <array>
+#include <cstdint>
+#include <deque>
+#include <set>
+#include <vector>
+
+namespace hal {
+
+// simulated time since boot
+extern uint64_t now;
+
+/*
+ * Moves simulated time forward, firing any interrupts that come due on the way
+ */
+void Advance(uint32_t us);
+
+// the 13-bit voltage on each of the mux's 16 inputs
+extern std::array<uint16_t, 16> mux_inputs;
+
+/*
+ * Sets the 13-bit voltage on a physical fader, through the board's mux wiring
+ */
+void SetFader(int fader, uint16_t value);
+
+// i2c addresses that answer when we're the leader
+extern std::set<uint8_t> i2c_followers;
+
+/// What has gone out of each port
+struct Counters {
+  uint32_t usb_messages = 0;
+  uint32_t usb_flushes = 0;
+  uint32_t usb_sysex = 0;
+  uint32_t trs_bytes = 0;
+  uint32_t trs_stalls = 0;  // writes that had to wait for the UART
+  uint32_t i2c_transfers = 0;
+  uint32_t i2c_naks = 0;
+  uint32_t eeprom_writes = 0;
+};
+extern Counters counters;
+
+/// A MIDI message sent over USB
+struct UsbMessage {
+  uint64_t at;
+  uint8_t status;
+  uint8_t data1;
+  uint8_t data2;
+};
+
+// every USB message sent, when recording is on
+extern bool record_usb;
+extern std::vector<UsbMessage> usb_log;
+
+// the last SysEx message sent over USB, as passed to sendSysEx
+extern std::vector<uint8_t> last_sysex;
+
+// every byte written to Serial1, when recording is on
+extern bool record_trs;
+extern std::vector<uint8_t> trs_log;
+
+// MIDI waiting to be read: messages on USB, status byte first, and bytes on Serial1
+extern std::deque<std::vector<uint8_t>> usb_inbound;
+extern std::deque<uint8_t> trs_inbound;
+
+/*
+ * Hands a SysEx message to the firmware's usbMIDI handler, as if it had arrived over USB
+ */
+void ReceiveSysEx(const std::vector<uint8_t>& sysex);
+
+/*
+ * Talks to the firmware as an i2c leader would when it's a follower: a write of some bytes,
+ * or a read, which returns everything the firmware answered with
+ */
+void LeaderWrite(const std::vector<uint8_t>& data);
+std::vector<uint8_t> LeaderRead();
+}  // namespace hal
@@ -0,0 +1,69 @@
+#pragma once
+/*
+ * Host stand-in for i2c_t3. As leader, transfers take simulated time at 400kHz and
+ * only the addresses in hal::i2c_followers answer.
+ */
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+enum i2c_mode { I2C_MASTER, I2C_SLAVE };
+enum i2c_pins { I2C_PINS_18_19, I2C_PINS_29_30 };
+enum i2c_pullup { I2C_PULLUP_EXT, I2C_PULLUP_INT };
+enum i2c_stop { I2C_NOSTOP, I2C_STOP };
+enum i2c_status {
+  I2C_WAITING,
+  I2C_TIMEOUT,
+  I2C_ADDR_NAK,
+  I2C_DATA_NAK,
+  I2C_ARB_LOST,
+  I2C_BUF_OVF,
+  I2C_NOT_ACQ,
+  I2C_DMA_ERR,
+  I2C_SENDING,
+  I2C_SEND_ADDR,
+  I2C_RECEIVING,
+  I2C_SLAVE_TX,
+  I2C_SLAVE_RX,
+};
+
+class i2c_t3 {
+ public:
+  void begin();
+  void begin(i2c_mode mode, uint8_t address, i2c_pins pins, i2c_pullup pullup, uint32_t rate);
+  void setDefaultTimeout(uint32_t timeout);
+  void resetBus();
+
+  void beginTransmission(uint8_t address);
+  uint8_t endTransmission(i2c_stop stop = I2C_STOP);
+  void sendTransmission(i2c_stop stop = I2C_STOP);
+  uint8_t done();
+  i2c_status status();
+
+  size_t write(uint8_t data);
+  size_t write(const uint8_t* data, size_t length);
+  int available();
+  int read();
+
+  void onReceive(void (*handler)(size_t length));
+  void onRequest(void (*handler)());
+
+  void (*receive_handler_)(size_t length) = nullptr;
+  void (*request_handler_)() = nullptr;
+
+  // follower side: what the leader wrote, and what we answered
+  std::array<uint8_t, 32> rx_buffer_;
+  size_t rx_length_ = 0;
+  size_t rx_position_ = 0;
+  std::array<uint8_t, 64> tx_buffer_;
+  size_t tx_length_ = 0;
+
+ private:
+  uint8_t address_ = 0;
+  size_t length_ = 0;
+  i2c_status status_ = I2C_WAITING;
+  uint64_t done_at_ = 0;
+};
+
+extern i2c_t3 Wire;
+extern i2c_t3 Wire1;
@@ -0,0 +1,184 @@
+/*
+ * 16n Faderbank ADC trace replay
+ * MIT License
+ *
+ * Plays a trace captured with TRACE_ADC back through the firmware, with each fader held at its recorded
+ * sample until the next frame, and reports what came out and how long it took.
+ */
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "replay.hpp"
+
+#include "configuration.hpp"
+#include "hal.hpp"
+
+void loop();
+
+namespace {
+
+constexpr uint32_t loop_time = 5;  // us of simulated time per pass through loop()
+
+// a message that undoes the one before it within this long is put down to noise, not movement
+constexpr uint64_t reversal_window = 250000;  // 250ms
+
+/// One line of a trace
+struct TraceFrame {
+  uint32_t at;  // micros() on the device
+  std::array<uint16_t, kNumChannels> samples;
+};
+
+bool Load(const char* path, std::vector<TraceFrame>& frames) {
+  std::ifstream file(path);
+  if (!file) {
+    return false;
+  }
+
+  // anything that doesn't start with a timestamp is a comment or debug output
+  std::string line;
+  while (std::getline(file, line)) {
+    if (line.empty() || !std::isdigit(static_cast<unsigned char>(line[0]))) {
+      continue;
+    }
+
+    std::istringstream fields(line);
+    TraceFrame frame;
+    fields >> frame.at;
+    for (auto& sample : frame.samples) {
+      fields >> sample;
+    }
+    if (fields) {
+      frames.push_back(frame);
+    }
+  }
+  return true;
+}
+
+/*
+ * Where the fader's raw sample sits on the 0-16383 output scale
+ */
+int Mapped(int channel, uint16_t sample) {
+  const int value = config.calibrations[channel].Map(sample);
+  return config.rotate ? 16383 - value : value;
+}
+
+double Percentile(std::vector<uint64_t>& values, double p) {
+  if (values.empty()) {
+    return 0;
+  }
+  const size_t i = std::min<size_t>(values.size() * p, values.size() - 1);
+  std::nth_element(values.begin(), values.begin() + i, values.end());
+  return values[i] / 1000.0;
+}
+}  // namespace
+
+/*
+ * Latency is measured on 7-bit USB messages: from the first frame where a fader's sample is a whole step
+ * away from the last value sent for it, to the next message sent for it.
+ */
+bool Replay(const char* path, ReplayResult& result) {
+  std::vector<TraceFrame> frames;
+  if (!Load(path, frames) || frames.empty()) {
+    fprintf(stderr, "couldn't read a trace from %s\n", path);
+    return false;
+  }
+
+  hal::counters = {};
+  hal::usb_log.clear();
+  hal::record_usb = true;
+  size_t logged = 0;
+
+  // where each channel's last message put it, and when its sample first moved a step away from there
+  std::array<int, kNumChannels> sent;
+  std::array<int, kNumChannels> previous;
+  std::array<uint64_t, kNumChannels> sent_at{};
+  std::array<uint64_t, kNumChannels> moved_at{};
+  sent.fill(-1);
+  previous.fill(-1);
+
+  std::vector<uint64_t> latencies;
+  uint32_t reversals = 0;
+  uint32_t unprompted = 0;
+
+  const uint64_t start = hal::now;
+  for (size_t f = 0; f < frames.size(); f++) {
+    const TraceFrame& frame = frames[f];
+    const uint64_t frame_at = start + (frame.at - frames[0].at);
+
+    for (int c = 0; c < kNumChannels; c++) {
+      // frames are in channel order, which is the reverse of the physical faders when rotated
+      hal::SetFader(config.rotate ? kNumChannels - c - 1 : c, frame.samples[c]);
+
+      const int distance = sent[c] < 0 ? 0 : std::abs(Mapped(c, frame.samples[c]) - sent[c]);
+      if (distance >= 128 && !moved_at[c]) {
+        moved_at[c] = frame_at;
+      }
+      else if (distance < 64) {
+        moved_at[c] = 0;
+      }
+    }
+
+    // run the firmware until the next frame was recorded
+    const uint64_t until = f + 1 < frames.size() ? start + (frames[f + 1].at - frames[0].at) : frame_at + 100000;
+    while (hal::now < until) {
+      loop();
+      hal::Advance(loop_time);
+
+      for (; logged < hal::usb_log.size(); logged++) {
+        const auto& message = hal::usb_log[logged];
+        for (int c = 0; c < kNumChannels; c++) {
+          // each fader's first destination is its USB output
+          const Config::Destination& usb = config.mapping->destinations[config.mapping->first[c]];
+          if (message.status != (0xB0 | (usb.channel - 1)) || message.data1 != usb.number) {
+            continue;
+          }
+
+          // the middle of the step the message stands for
+          const int value = (message.data2 << 7) + 64;
+          if (moved_at[c]) {
+            latencies.push_back(message.at - moved_at[c]);
+            moved_at[c] = 0;
+          }
+          else if (sent[c] >= 0) {
+            unprompted++;
+          }
+
+          if (value == previous[c] && message.at - sent_at[c] < reversal_window) {
+            reversals++;
+          }
+          previous[c] = sent[c];
+          sent[c] = value;
+          sent_at[c] = message.at;
+        }
+      }
+    }
+  }
+
+  hal::record_usb = false;
+
+  result.frames = frames.size();
+  result.seconds = (hal::now - start) / 1e6;
+  result.usb_messages = hal::counters.usb_messages;
+  result.trs_bytes = hal::counters.trs_bytes;
+  result.i2c_transfers = hal::counters.i2c_transfers;
+  result.p50 = Percentile(latencies, .5);
+  result.p90 = Percentile(latencies, .9);
+  result.p99 = Percentile(latencies, .99);
+  result.max = Percentile(latencies, 1);
+  result.moves = latencies.size();
+  result.reversals = reversals;
+  result.unprompted = unprompted;
+
+  printf("%s: %zu frames, %.1fs\n", path, result.frames, result.seconds);
+  printf("messages: %u usb, %u trs bytes, %u i2c transfers\n", result.usb_messages, result.trs_bytes,
+         result.i2c_transfers);
+  printf("latency (ms): p50 %.2f  p90 %.2f  p99 %.2f  max %.2f  (%zu moves)\n", result.p50, result.p90, result.p99,
+         result.max, result.moves);
+  printf("jitter: %u messages reversed within %llums, %u sent without a step of movement\n", reversals,
+         static_cast<unsigned long long>(reversal_window / 1000), unprompted);
+  return true;
+}
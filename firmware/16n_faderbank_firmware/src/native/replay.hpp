@@ -0,0 +1,28 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+/// What came out of replaying a trace
+struct ReplayResult {
+  size_t frames = 0;
+  double seconds = 0;
+  uint32_t usb_messages = 0;
+  uint32_t trs_bytes = 0;
+  uint32_t i2c_transfers = 0;
+
+  // latency percentiles in ms, over this many moves
+  double p50 = 0;
+  double p90 = 0;
+  double p99 = 0;
+  double max = 0;
+  size_t moves = 0;
+
+  uint32_t reversals = 0;   // messages that undid the one before within the reversal window
+  uint32_t unprompted = 0;  // messages sent without a step of movement
+};
+
+/*
+ * Plays a trace captured with TRACE_ADC back through the firmware, printing what came out.
+ * Returns false if there was no trace to read.
+ */
+bool Replay(const char* path, ReplayResult& result);
@@ -0,0 +1,120 @@
+/*
+ * 16n Faderbank idle mode
+ * MIT License
+ */
+#include "power.hpp"
+
+#include <Arduino.h>
+#include <algorithm>
+#include <cstdlib>
+#include "configuration.hpp"
+#include "filter.hpp"
+#include "scan.hpp"
+
+#ifndef NATIVE
+// the host stand-in skips simulated time ahead to the next interrupt instead
+inline void wait_for_interrupt() {
+  asm volatile("wfi");
+}
+#endif
+
+static bool idle_ = false;
+static uint32_t active_at = 0;  // millis() of the last frame with a fader moving
+static scan::Frame last_frame{};
+
+// time, in us, since the stats were last reset
+static uint32_t tallied_at = 0;
+static uint64_t total_us = 0;
+static uint64_t idle_us = 0;
+static uint64_t sleep_us = 0;
+
+static uint32_t idles = 0;
+static uint32_t wakes = 0;
+static uint64_t wake_latency_total = 0;
+static uint32_t worst_wake_latency = 0;
+
+namespace power {
+/*
+ * Counts the time since the last tally, as idle or not
+ */
+void Tally(uint32_t now) {
+  const uint32_t elapsed = now - tallied_at;
+  total_us += elapsed;
+  if (idle_) {
+    idle_us += elapsed;
+  }
+  tallied_at = now;
+}
+
+void SetIdle(bool idle) {
+  Tally(micros());
+  idle_ = idle;
+  idles += idle;
+  scan::SetIdle(idle);
+  filters.SetFrameInterval(idle ? scan::idle_frame_interval : scan::frame_interval);
+  DEBUG_PRINTLN(idle ? "Going idle" : "Back to full speed");
+}
+
+void Update(const scan::Frame& frame, bool active) {
+  const uint32_t now = millis();
+
+  if (idle_) {
+    // how long the frame waited for us to wake up and pick it up
+    const uint32_t latency = micros() - scan::frame_time();
+    wakes++;
+    wake_latency_total += latency;
+    worst_wake_latency = std::max(worst_wake_latency, latency);
+
+    // a fader that jumps wakes us on this frame, without waiting for the filters to follow it
+    for (size_t c = 0; c < frame.size(); c++) {
+      active |= std::abs(frame[c] - last_frame[c]) > wake_threshold;
+    }
+  }
+  last_frame = frame;
+
+  if (active) {
+    active_at = now;
+  }
+
+  if (idle_ && (active || !config.idle_timeout)) {
+    SetIdle(false);
+  }
+  else if (!idle_ && config.idle_timeout && now - active_at >= config.idle_timeout * 1000u) {
+    SetIdle(true);
+  }
+}
+
+void Sleep() {
+  if (!idle_) {
+    return;
+  }
+
+  const uint32_t slept_at = micros();
+  Tally(slept_at);
+  wait_for_interrupt();
+  sleep_us += micros() - slept_at;
+}
+
+bool idle() {
+  return idle_;
+}
+
+void Read(Stats& stats, bool reset) {
+  Tally(micros());
+
+  stats.idles = idles;
+  stats.idle_time = idle_us / 1000;
+  stats.sleep_time = sleep_us / 1000;
+  stats.total_time = total_us / 1000;
+  stats.worst_wake_latency = worst_wake_latency;
+  stats.average_wake_latency = wakes ? wake_latency_total / wakes : 0;
+  stats.average_current =
+      total_us ? (run_current * (total_us - sleep_us) + sleep_current * sleep_us) / total_us : run_current;
+
+  if (reset) {
+    total_us = idle_us = sleep_us = 0;
+    idles = wakes = worst_wake_latency = 0;
+    wake_latency_total = 0;
+  }
+}
+}  // namespace power
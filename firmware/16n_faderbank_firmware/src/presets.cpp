@@ -0,0 +1,53 @@
+/*
+ * 16n Faderbank presets
+ * MIT License
+ */
+#include "presets.hpp"
+
+#include "configuration.hpp"
+#include "midi.hpp"
+
+namespace presets {
+
+void Recall(size_t preset) {
+  if (preset > Config::NUM_PRESETS) {
+    return;
+  }
+
+  DEBUG_PRINTF("Recalling preset %d\n", preset);
+  config.mapping = &config.mappings[preset];
+
+  // remembered for next time, written out with the rest of the config
+  const uint8_t active = preset;
+  config.Edit(Config::PRESET_ACTIVE, {&active, 1});
+
+  if (config.preset_snapshot) {
+    MIDI::force_write();
+  }
+}
+
+void Store(size_t preset) {
+  if (preset < 1 || preset > Config::NUM_PRESETS) {
+    return;
+  }
+
+  DEBUG_PRINTF("Storing preset %d\n", preset);
+  config.StorePreset(preset);
+  config.Load();
+}
+
+void Write(size_t preset, std::span<const uint8_t> data) {
+  if (preset < 1 || preset > Config::NUM_PRESETS || data.size() < Config::PRESET_SIZE) {
+    return;
+  }
+
+  config.Edit(Config::PRESETS + (preset - 1) * Config::PRESET_SIZE, data.first(Config::PRESET_SIZE));
+  config.Load();
+}
+
+void ProgramChange(uint8_t channel, uint8_t program) {
+  if (config.preset_channel && channel == config.preset_channel) {
+    Recall(program);
+  }
+}
+}  // namespace presets
@@ -0,0 +1,54 @@
+/*
+ * 16n Faderbank cycle count profiling
+ * MIT License
+ */
+#include "profile.hpp"
+
+static std::array<profile::Stats, profile::NUM_SECTIONS> sections;
+static volatile uint32_t overruns_ = 0;
+
+constexpr uint32_t cycles_per_us = F_CPU / 1000000;
+
+namespace profile {
+
+void Setup() {
+  if constexpr (!PROFILING) {
+    return;
+  }
+
+  ARM_DEMCR |= ARM_DEMCR_TRCENA;
+  ARM_DWT_CTRL |= ARM_DWT_CTRL_CYCCNTENA;
+}
+
+void Record(Section section, uint32_t cycles) {
+  // each section is only recorded from one context, so this doesn't need interrupts off
+  Stats& stats = sections[section];
+  stats.count++;
+  stats.total += cycles;
+  stats.min = std::min(stats.min, cycles);
+  stats.max = std::max(stats.max, cycles);
+
+  size_t bucket = 0;
+  while (bucket < bucket_edges.size() && cycles >= bucket_edges[bucket] * cycles_per_us) {
+    bucket++;
+  }
+  stats.histogram[bucket]++;
+}
+
+void Overrun() {
+  if constexpr (PROFILING) {
+    overruns_ = overruns_ + 1;
+  }
+}
+
+void Read(std::array<Stats, NUM_SECTIONS>& stats, uint32_t& overruns, bool reset) {
+  noInterrupts();
+  stats = sections;
+  overruns = overruns_;
+  if (reset) {
+    sections = {};
+    overruns_ = 0;
+  }
+  interrupts();
+}
+}  // namespace profile
@@ -0,0 +1,116 @@
+/*
+ * 16n Faderbank background ADC scan
+ * MIT License
+ */
+#include "scan.hpp"
+
+#include <ADC.h>
+#include <Arduino.h>
+#include <CD74HC4067.h>
+#include "configuration.hpp"
+#include "profile.hpp"
+
+static ADC adc;
+static IntervalTimer step_timer;
+
+// mux config
+static CD74HC4067 mux{8, 7, 6, 5};
+constexpr std::array mux_map = {0, 1, 2, 3, 4, 5, 6, 7, 15, 14, 13, 12, 11, 10, 9, 8};
+
+// the ISRs fill frames[filling], while frames[filling ^ 1] holds the last complete frame
+static std::array<scan::Frame, 2> frames;
+static volatile uint8_t filling = 0;
+static volatile bool frame_ready = false;
+
+// when each frame was completed, and when the last one we handed out was
+static std::array<uint32_t, 2> completed_at;
+static uint32_t read_frame_at;
+
+// the channel currently selected on the mux
+static volatile int channel = 0;
+static volatile bool converting = false;
+
+namespace scan {
+
+void SelectChannel(int c) {
+  if constexpr (V125) {
+    return;
+  }
+
+  // set mux to appropriate channel
+  auto mux_channel = config.rotate ? kNumChannels - c - 1 : c;
+  mux.channel(mux_map[mux_channel]);
+}
+
+/*
+ * Timer tick: the mux has had the rest of the previous step to settle, so convert.
+ */
+void StartConversion() {
+  if (converting) {
+    // conversion overran the step, skip this tick rather than aborting it
+    return;
+  }
+
+  converting = true;
+  if constexpr (V125) {
+    adc.adc0->startSingleRead(config.legacy_ports[channel]);
+  }
+  else {
+    adc.adc0->startSingleRead(A0);  // mux goes into A0
+  }
+}
+
+/*
+ * ADC conversion complete interrupt: store the sample and move the mux on,
+ * so it settles while we wait for the next timer tick.
+ */
+void ConversionComplete() {
+  profile::Scope scope{profile::SCAN_ISR};
+
+  // the ADC runs in 16 bit mode, keep the usable bits
+  frames[filling][channel] = adc.adc0->readSingle() >> (16 - resolution);
+  converting = false;
+
+  if (++channel == kNumChannels) {
+    channel = 0;
+    completed_at[filling] = micros();
+    filling ^= 1;
+    frame_ready = true;
+  }
+
+  SelectChannel(channel);
+}
+
+void Setup() {
+  adc.adc0->setResolution(16);
+  adc.adc0->setAveraging(4);
+  adc.adc0->enableInterrupts(ConversionComplete);
+}
+
+void Start() {
+  channel = 0;
+  SelectChannel(channel);
+  step_timer.begin(StartConversion, step_interval);
+}
+
+void SetIdle(bool idle) {
+  step_timer.update(idle ? idle_step_interval : step_interval);
+}
+
+bool Read(Frame& frame) {
+  if (!frame_ready) {
+    return false;
+  }
+
+  noInterrupts();
+  frame = frames[filling ^ 1];
+  read_frame_at = completed_at[filling ^ 1];
+  frame_ready = false;
+  interrupts();
+  return true;
+}
+
+uint32_t frame_time() {
+  return read_frame_at;
+}
+}  // namespace scan
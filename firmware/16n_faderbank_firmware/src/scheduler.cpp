@@ -0,0 +1,119 @@
+/*
+ * 16n Faderbank cooperative scheduler
+ * MIT License
+ */
+#include "scheduler.hpp"
+
+#include <Arduino.h>
+#include <algorithm>
+#include "profile.hpp"
+
+/// A task, when it's next due, and how it has done so far
+struct Entry {
+  scheduler::Function function;
+  uint32_t period;  // us, 0 for every pass
+  uint32_t deadline;
+  scheduler::Priority priority;
+  bool one_shot;
+  bool armed;
+  uint32_t due_at;
+  scheduler::Stats stats;
+};
+
+static std::array<Entry, scheduler::max_tasks> tasks;
+static size_t num_tasks = 0;
+
+namespace scheduler {
+Task Add(const Entry& entry) {
+  if (num_tasks == tasks.size()) {
+    DEBUG_PRINTLN("No room for another task");
+    return max_tasks;
+  }
+  tasks[num_tasks] = entry;
+  return num_tasks++;
+}
+
+Task Every(uint32_t period, Priority priority, uint32_t deadline, Function function) {
+  return Add({function, period, deadline, priority, false, true, micros() + period, {}});
+}
+
+Task Once(Priority priority, uint32_t deadline, Function function) {
+  return Add({function, 0, deadline, priority, true, false, 0, {}});
+}
+
+void Arm(Task task, uint32_t delay) {
+  if (task >= num_tasks) {
+    return;
+  }
+  tasks[task].due_at = micros() + delay;
+  tasks[task].armed = true;
+}
+
+/*
+ * Is a more urgent than b? Priority first, then the nearer deadline.
+ */
+bool MoreUrgent(const Entry& a, const Entry& b) {
+  if (a.priority != b.priority) {
+    return a.priority > b.priority;
+  }
+  return static_cast<int32_t>((a.due_at + a.deadline) - (b.due_at + b.deadline)) < 0;
+}
+
+void Run() {
+  // what's due, most urgent first. Anything that comes due while these run waits for the next pass.
+  std::array<uint8_t, max_tasks> due;
+  size_t num_due = 0;
+  const uint32_t now = micros();
+  for (size_t i = 0; i < num_tasks; i++) {
+    if (!tasks[i].armed || static_cast<int32_t>(now - tasks[i].due_at) < 0) {
+      continue;
+    }
+
+    size_t at = num_due++;
+    for (; at > 0 && MoreUrgent(tasks[i], tasks[due[at - 1]]); at--) {
+      due[at] = due[at - 1];
+    }
+    due[at] = i;
+  }
+
+  for (size_t i = 0; i < num_due; i++) {
+    Entry& task = tasks[due[i]];
+    const uint32_t started = micros();
+    const uint32_t lateness = started - task.due_at;
+    task.stats.runs++;
+    task.stats.worst_lateness = std::max(task.stats.worst_lateness, lateness);
+    if (lateness > task.deadline) {
+      task.stats.misses++;
+      profile::Overrun();
+    }
+
+    // set up the next run first, so a one-shot can arm itself again
+    if (task.one_shot) {
+      task.armed = false;
+    }
+    else if (task.period == 0) {
+      task.due_at = started;
+    }
+    else {
+      task.due_at += task.period;
+
+      // periods that went by while it waited are dropped, not run back to back
+      if (static_cast<int32_t>(started - task.due_at) >= 0) {
+        task.due_at += ((started - task.due_at) / task.period + 1) * task.period;
+      }
+    }
+
+    task.function();
+  }
+}
+
+size_t Read(std::array<Stats, max_tasks>& stats, bool reset) {
+  for (size_t i = 0; i < num_tasks; i++) {
+    stats[i] = tasks[i].stats;
+    if (reset) {
+      tasks[i].stats = {};
+    }
+  }
+  return num_tasks;
+}
+}  // namespace scheduler
@@ -6,19 +6,55 @@
 #include "sysex.hpp"
 
 #include <algorithm>
+#include "calibration.hpp"
 #include "config.h"
 #include "configuration.hpp"
-#include "midi.hpp"
+#include "filter.hpp"
+#include "power.hpp"
+#include "presets.hpp"
+#include "profile.hpp"
+#include "scheduler.hpp"
 #include "state.hpp"
+#include "telemetry.hpp"
+#include "thru.hpp"
 #include "utils.hpp"
 
+// what goes in a state message as well as the fader values
+constexpr uint8_t state_raw = 1 << 0;       // the raw samples from the scan
+constexpr uint8_t state_filtered = 1 << 1;  // the filters' outputs, before calibration
+
+// how long a stream of state messages keeps going without another request
+constexpr uint32_t stream_timeout = 5000;  // 5s
+
+// the state messages being streamed, if any
+static uint8_t stream_options = 0;
+static uint32_t stream_interval = 0;  // ms, 0 when not streaming
+static uint32_t stream_next_at = 0;
+static uint32_t stream_requested_at = 0;
+
+// F0, the manufacturer and the message type
+constexpr size_t header_size = 5;
+
+// device ID and version, at the front of a whole config
+constexpr size_t prelude_size = 4;
+
+// the longest message we take: a whole config with its prelude, then F7
+constexpr size_t max_message_size = header_size + prelude_size + Config::SIZE + 1;
+
+// the message being put back together from the chunks usbMIDI hands over
+static std::array<byte, max_message_size> assembled;
+static size_t assembled_size = 0;
+static bool overflowed = false;  // too long for the buffer, dropped when it ends
+static bool forwarding = false;  // someone else's, going on to thru as it arrives rather than being put together
+
 namespace sysex {
-void UpdateConfig(Config::Address eeprom_position, std::span<byte> data) {
-  // write new Data
-  eeprom::write(data, eeprom_position);
+void UpdateConfig(Config::Address eeprom_position, std::span<const byte> data) {
+  // take the new data, it's written to EEPROM later, when the editor has finished
+  config.Edit(eeprom_position, data);
 
   // now load that.
   config.Load();
+  filters.Configure(config);
 }
 
 void SendConfig() {
@@ -35,9 +71,9 @@ void SendConfig() {
   sysex[6] = MINOR_VERSION;  // minor version
   sysex[7] = POINT_VERSION;  // point version
 
-  // So that's 3 for the mfg + 1 for the message + 80 bytes
-  // can be done with a simple "read eighty bytes and send them."
-  std::array buffer = eeprom::read<Config::SIZE>();
+  // So that's 3 for the mfg + 1 for the message + the config block,
+  // which is already in RAM.
+  const auto& buffer = config.image;
 
   // Clamp our EEPROM values and stick them in the output SysEx message with the proper offset
   std::transform(buffer.begin(), buffer.end(), sysex.begin() + 8, [](byte data) {
@@ -48,73 +84,411 @@ void SendConfig() {
   debug::printArray(sysex);
 
   usbMIDI.sendSysEx(Config::SIZE + 8, sysex.data(), false);
-  MIDI::force_write();
 }
 
-void Parse(uint8_t* sysex, size_t size) {
+/*
+ * Writes a 32 bit value as five 7-bit bytes, least significant first
+ */
+byte* Pack(byte* out, uint32_t value) {
+  for (int i = 0; i < 5; i++) {
+    *out++ = value & 0x7F;
+    value >>= 7;
+  }
+  return out;
+}
+
+void SendProfile(bool reset) {
+  // per section: count, min, average and max cycles, then the histogram
+  constexpr size_t section_size = 5 * (4 + std::tuple_size_v<decltype(profile::Stats::histogram)>);
+  std::array<byte, 16 + profile::NUM_SECTIONS * section_size> sysex;
+
+  std::array<profile::Stats, profile::NUM_SECTIONS> stats;
+  uint32_t overruns;
+  profile::Read(stats, overruns, reset);
+
+  sysex[0] = 0x7d;  // manufacturer
+  sysex[1] = 0x00;
+  sysex[2] = 0x00;
+
+  sysex[3] = OutboundMessageType::PROFILE;
+
+  sysex[4] = DEVICE_ID;
+  sysex[5] = MAJOR_VERSION;
+  sysex[6] = MINOR_VERSION;
+  sysex[7] = POINT_VERSION;
+
+  // with profiling compiled out there are no sections to send
+  const size_t sections = PROFILING ? profile::NUM_SECTIONS : 0;
+  sysex[8] = F_CPU / 1000000 & 0x7F;
+  sysex[9] = F_CPU / 1000000 >> 7;
+  sysex[10] = sections;
+
+  byte* out = Pack(sysex.data() + 11, overruns);
+  for (size_t s = 0; s < sections; s++) {
+    out = Pack(out, stats[s].count);
+    out = Pack(out, stats[s].count ? stats[s].min : 0);
+    out = Pack(out, stats[s].count ? stats[s].total / stats[s].count : 0);
+    out = Pack(out, stats[s].max);
+    for (uint32_t bucket : stats[s].histogram) {
+      out = Pack(out, bucket);
+    }
+  }
+
+  usbMIDI.sendSysEx(out - sysex.data(), sysex.data(), false);
+}
+
+/*
+ * Writes a 14 bit value as two 7-bit bytes, least significant first
+ */
+byte* Pack14(byte* out, uint16_t value) {
+  *out++ = value & 0x7F;
+  *out++ = (value >> 7) & 0x7F;
+  return out;
+}
+
+/*
+ * Sends every fader's current value in one message, and the raw samples and filter outputs if asked for
+ */
+void SendState(uint8_t options) {
+  std::array<byte, 9 + 3 * 2 * kNumChannels> sysex;
+
+  sysex[0] = 0x7d;  // manufacturer
+  sysex[1] = 0x00;
+  sysex[2] = 0x00;
+
+  sysex[3] = OutboundMessageType::STATE;
+
+  sysex[4] = DEVICE_ID;
+  sysex[5] = MAJOR_VERSION;
+  sysex[6] = MINOR_VERSION;
+  sysex[7] = POINT_VERSION;
+
+  sysex[8] = options & (state_raw | state_filtered);
+
+  byte* out = sysex.data() + 9;
+  for (int value : state.current) {
+    out = Pack14(out, value);
+  }
+  if (options & state_raw) {
+    for (uint16_t sample : state.raw) {
+      out = Pack14(out, sample);
+    }
+  }
+  if (options & state_filtered) {
+    for (size_t c = 0; c < kNumChannels; c++) {
+      out = Pack14(out, filters.value(c));
+    }
+  }
+
+  usbMIDI.sendSysEx(out - sysex.data(), sysex.data(), false);
+}
+
+/*
+ * Sends the state now, and with an interval, every interval x 10ms until requests stop coming
+ */
+void RequestState(uint8_t options, uint8_t interval) {
+  SendState(options);
+
+  stream_options = options;
+  stream_interval = interval * 10;
+  stream_requested_at = millis();
+  stream_next_at = millis() + stream_interval;
+}
+
+void Service() {
+  if (!stream_interval) {
+    return;
+  }
+
+  // the editor has gone away, or stopped asking
+  if (millis() - stream_requested_at > stream_timeout) {
+    stream_interval = 0;
+    return;
+  }
+
+  if (static_cast<int32_t>(millis() - stream_next_at) >= 0) {
+    stream_next_at = millis() + stream_interval;
+    SendState(stream_options);
+  }
+}
+
+void SendTelemetry(bool reset) {
+  // 9 counters, then an address and 3 counters for each follower, 3 counters for each task, 7 for idling, then thru
+  std::array<byte, 8 + 9 * 5 + 1 + i2c::num_devices * 16 + 1 + scheduler::max_tasks * 15 + 7 * 5 + 5> sysex;
+
+  sysex[0] = 0x7d;  // manufacturer
+  sysex[1] = 0x00;
+  sysex[2] = 0x00;
+
+  sysex[3] = OutboundMessageType::STATS;
+
+  sysex[4] = DEVICE_ID;
+  sysex[5] = MAJOR_VERSION;
+  sysex[6] = MINOR_VERSION;
+  sysex[7] = POINT_VERSION;
+
+  noInterrupts();
+  const Telemetry counters = telemetry;
+  if (reset) {
+    telemetry.Reset();
+  }
+  interrupts();
+
+  std::array<scheduler::Stats, scheduler::max_tasks> tasks;
+  const size_t num_tasks = scheduler::Read(tasks, reset);
+
+  power::Stats power;
+  power::Read(power, reset);
+
+  byte* out = sysex.data() + 8;
+  for (uint32_t counter : {counters.usb_messages, counters.trs_messages, counters.suppressed, counters.trs_coalesced,
+                           counters.i2c_coalesced, counters.trs_stalls, counters.sysex_parsed, counters.sysex_rejected,
+                           counters.loops_per_second}) {
+    out = Pack(out, counter);
+  }
+
+  *out++ = counters.followers.size();
+  for (const auto& follower : counters.followers) {
+    *out++ = follower.address;
+    out = Pack(out, follower.transfers);
+    out = Pack(out, follower.naks);
+    out = Pack(out, follower.timeouts);
+  }
+
+  *out++ = num_tasks;
+  for (const auto& task : std::span{tasks}.first(num_tasks)) {
+    out = Pack(out, task.runs);
+    out = Pack(out, task.misses);
+    out = Pack(out, task.worst_lateness);
+  }
+
+  for (uint32_t counter : {power.idles, power.idle_time, power.sleep_time, power.total_time, power.worst_wake_latency,
+                           power.average_wake_latency, power.average_current}) {
+    out = Pack(out, counter);
+  }
+  out = Pack(out, counters.thru_dropped);
+
+  usbMIDI.sendSysEx(out - sysex.data(), sysex.data(), false);
+}
+
+void OnRequestInfo(std::span<const byte>) {
+  DEBUG_PRINTLN("Got an 1nFo request");
+  SendConfig();
+
+  // and the faders, so the editor looks nice, without sending them out of every port
+  SendState(0);
+}
+
+void OnRequestState(std::span<const byte> payload) {
+  DEBUG_PRINTLN("Got a State request");
+  RequestState(payload.size() > 0 ? payload[0] : 0, payload.size() > 1 ? payload[1] : 0);
+}
+
+void OnRequestStats(std::span<const byte> payload) {
+  DEBUG_PRINTLN("Got a Stats request");
+  SendTelemetry(payload.size() > 0 && payload[0] == 1);
+}
+
+void OnRequestProfile(std::span<const byte> payload) {
+  DEBUG_PRINTLN("Got a Profile request");
+  SendProfile(payload.size() > 0 && payload[0] == 1);
+}
+
+void OnEditConfig(std::span<const byte> payload) {
+  DEBUG_PRINTLN("Incoming c0nfig Edit");
+  DEBUG_PRINTF("Received a new config with size %zu\n", payload.size());
+
+  // The full config includes the SysEx prelude of device ID and version (4 bytes)
+  // We don't need that, so remove it from the front.
+  // Editors that predate the filter block send only the first 80 bytes, and that's fine.
+  UpdateConfig(Config::Address(0), payload.subspan(4));
+}
+
+void OnEditConfigDevice(std::span<const byte> payload) {
+  DEBUG_PRINTLN("Incoming c0nfig Device edit");
+  UpdateConfig(Config::Address(0), payload);
+}
+
+void OnEditConfigUsb(std::span<const byte> payload) {
+  DEBUG_PRINTLN("Incoming c0nfig usb edit");
+  UpdateConfig(Config::MIDI_USB_CHANNEL, payload.first(16));   // store channels
+  UpdateConfig(Config::MIDI_USB_CC, payload.subspan(16, 16));  // store CCs
+}
+
+void OnEditConfigTrs(std::span<const byte> payload) {
+  DEBUG_PRINTLN("Incoming c0nfig trs edit");
+  UpdateConfig(Config::MIDI_TRS_CHANNEL, payload.first(16));   // store channels
+  UpdateConfig(Config::MIDI_TRS_CC, payload.subspan(16, 16));  // store CCs
+}
+
+void OnEditConfigFilter(std::span<const byte> payload) {
+  DEBUG_PRINTLN("Incoming c0nfig filter edit");
+  UpdateConfig(Config::FILTER_MODE, payload);
+}
+
+void OnPreset(std::span<const byte> payload) {
+  DEBUG_PRINTLN("Incoming 1 Bank request");
+  switch (payload[0]) {
+    case 0:
+      presets::Recall(payload[1]);
+      break;
+    case 1:
+      presets::Store(payload[1]);
+      break;
+    case 2:
+      presets::Write(payload[1], payload.subspan(2));
+      break;
+  }
+}
+
+void OnCalibrate(std::span<const byte> payload) {
+  DEBUG_PRINTLN("Incoming Calibrate request");
+  switch (payload[0]) {
+    case 0:
+      calibration::Finish();
+      break;
+    case 1:
+      calibration::Start();
+      break;
+    case 2:
+      calibration::Clear();
+      break;
+  }
+}
+
+void OnInitialize(std::span<const byte>) {
+  DEBUG_PRINTLN("Incoming 1nitiAlize request");
+  config.FactoryReset();
+  config.Load();
+  filters.Configure(config);
+}
+
+/// What to do with one type of message, and how much payload it has to come with.
+/// The payload is everything between the 5 byte header and the F7.
+struct Handler {
+  InboundMessageType type;
+  size_t min_size;
+  size_t max_size;
+  void (*handle)(std::span<const byte> payload);
+};
+
+using enum InboundMessageType;
+constexpr std::array handlers = {
+    Handler{EDIT_CONFIG_FILTER, Config::FILTER_CONFIG_SIZE, Config::FILTER_CONFIG_SIZE, OnEditConfigFilter},
+    Handler{EDIT_CONFIG_TRS, 2 * Config::MIDI_CONFIG_SIZE, 2 * Config::MIDI_CONFIG_SIZE, OnEditConfigTrs},
+    Handler{EDIT_CONFIG_USB, 2 * Config::MIDI_CONFIG_SIZE, 2 * Config::MIDI_CONFIG_SIZE, OnEditConfigUsb},
+    Handler{EDIT_CONFIG_DEVICE, Config::DEVICE_CONFIG_SIZE, Config::DEVICE_CONFIG_SIZE, OnEditConfigDevice},
+    Handler{EDIT_CONFIG, prelude_size + Config::DEVICE_CONFIG_SIZE, prelude_size + Config::SIZE, OnEditConfig},
+    Handler{REQUEST_STATS, 0, 1, OnRequestStats},
+    Handler{REQUEST_STATE, 0, 2, OnRequestState},
+    Handler{REQUEST_PROFILE, 0, 1, OnRequestProfile},
+    Handler{INITIALIZE, 0, 0, OnInitialize},
+    Handler{PRESET, 2, 2 + Config::PRESET_SIZE, OnPreset},
+    Handler{CALIBRATE, 1, 1, OnCalibrate},
+    Handler{REQUEST_INFO, 0, 0, OnRequestInfo},
+};
+
+bool IsOurs(std::span<const byte> message) {
+  return message.size() >= 4 && message[1] == 0x7d && message[2] == 0x00 && message[3] == 0x00;
+}
+
+void Parse(std::span<const byte> message) {
   DEBUG_PRINTLN("Ooh, sysex");
-  debug::printArray(std::span{sysex, size});
+  debug::printArray(message);
   DEBUG_PRINTLN();
 
-  if (size < 3) {
-    DEBUG_PRINTLN("That's an empty sysex, bored now");
+  if (message.size() < header_size + 1 || message.front() != 0xF0 || message.back() != 0xF7) {
+    DEBUG_PRINTLN("That's not a whole sysex message, bored now");
+    telemetry.sysex_rejected++;
     return;
   }
 
-  if (!(sysex[1] == 0x7d && sysex[2] == 0x00 && sysex[3] == 0x00)) {
+  if (!IsOurs(message)) {
     DEBUG_PRINTLN("That's not a sysex message for us");
+    telemetry.sysex_rejected++;
     return;
   }
 
-  InboundMessageType message_type{sysex[4]};
+  const InboundMessageType type{message[4]};
+  const auto handler = std::find_if(handlers.begin(), handlers.end(), [&](const Handler& h) { return h.type == type; });
+  if (handler == handlers.end()) {
+    DEBUG_PRINTLN("That's not a message type we know");
+    telemetry.sysex_rejected++;
+    return;
+  }
 
-  // the SysEx data without the 5 byte header
-  std::span data{sysex + 5, size - 5};
+  const auto payload = message.subspan(header_size, message.size() - header_size - 1);
+  if (payload.size() < handler->min_size || payload.size() > handler->max_size) {
+    DEBUG_PRINTF("That's the wrong size for its type: %zu bytes\n", payload.size());
+    telemetry.sysex_rejected++;
+    return;
+  }
 
-  using enum InboundMessageType;
-  switch (message_type) {
-    case REQUEST_INFO:
-      DEBUG_PRINTLN("Got an 1nFo request");
-      SendConfig();
+  handler->handle(payload);
+  telemetry.sysex_parsed++;
+}
 
-      // also, in 1s time, please send the current state
-      // of the controls, so the editor looks nice.
-      state.forced_control_update.should_send = true;
-      state.forced_control_update.send_at = millis() + 1000;
-      break;
+void Receive(const byte* data, uint16_t length, bool complete) {
+  size_t forward_from = 0;  // where the bytes of this chunk still to go on to thru start
+  for (uint16_t i = 0; i < length; i++) {
+    // a start abandons anything unfinished
+    if (data[i] == 0xF0) {
+      if (forwarding) {
+        thru::ForwardSysEx({data + forward_from, i - forward_from});
+        thru::EndSysEx();
+      }
+      assembled_size = 0;
+      overflowed = false;
+      forwarding = false;
+    }
 
-    case EDIT_CONFIG:
-      DEBUG_PRINTLN("Incoming c0nfig Edit");
-      DEBUG_PRINTF("Received a new config with size %zu\n", size);
+    if (forwarding) {
+      continue;
+    }
 
-      // The full config includes the SysEx prelude of device ID and version (4 bytes)
-      // We don't need that, so remove it from the front
-      UpdateConfig(Config::Address(0), data.subspan(4, 80));
-      break;
+    if (assembled_size < assembled.size()) {
+      assembled[assembled_size++] = data[i];
+    }
+    else {
+      overflowed = true;
+    }
 
-    case EDIT_CONFIG_DEVICE:
-      DEBUG_PRINTLN("Incoming c0nfig Device edit");
-      DEBUG_PRINTF("Received a new device config with size %zu\n", size);
-      UpdateConfig(Config::Address(0), data.first(Config::DEVICE_CONFIG_SIZE));
-      break;
+    // once the header shows it's someone else's, it goes on a piece at a time, however long it is
+    if (assembled_size == 4 && !IsOurs({assembled.data(), assembled_size})) {
+      thru::ForwardSysEx({assembled.data(), assembled_size});
+      forwarding = true;
+      forward_from = i + 1;
+    }
+  }
 
-    case EDIT_CONFIG_USB:
-      DEBUG_PRINTLN("Incoming c0nfig usb edit");
-      UpdateConfig(Config::MIDI_USB_CHANNEL, data.first(16));   // store channels
-      UpdateConfig(Config::MIDI_USB_CC, data.subspan(16, 16));  // store CCs
-      break;
+  if (forwarding) {
+    thru::ForwardSysEx({data + forward_from, length - forward_from});
+  }
 
-    case EDIT_CONFIG_TRS:
-      DEBUG_PRINTLN("Incoming c0nfig trs edit");
-      UpdateConfig(Config::MIDI_TRS_CHANNEL, data.first(16));   // store channels
-      UpdateConfig(Config::MIDI_TRS_CC, data.subspan(16, 16));  // store CCs
-      break;
+  if (!complete) {
+    return;
+  }
 
-    case INITIALIZE:
-      DEBUG_PRINTLN("Incoming 1nitiAlize request");
-      config.FactoryReset();
-      config.Load();
-      break;
+  const std::span message{assembled.data(), assembled_size};
+  if (forwarding) {
+    DEBUG_PRINTLN("That's not a sysex message for us");
+    telemetry.sysex_rejected++;
+  }
+  else if (overflowed) {
+    DEBUG_PRINTLN("That sysex was too long for us");
+    telemetry.sysex_rejected++;
   }
+  else {
+    // one too short to tell goes on to TRS too
+    if (!IsOurs(message)) {
+      thru::ForwardSysEx(message);
+    }
+    Parse(message);
+  }
+  thru::EndSysEx();
+
+  assembled_size = 0;
+  overflowed = false;
+  forwarding = false;
 }
 }  // namespace sysex
@@ -0,0 +1,27 @@
+/*
+ * 16n Faderbank runtime telemetry
+ * MIT License
+ */
+#include "telemetry.hpp"
+#include <Arduino.h>
+
+void Telemetry::CountLoop() {
+  loops_++;
+
+  const uint32_t now = millis();
+  if (now - second_started_at_ >= 1000) {
+    loops_per_second = loops_;
+    loops_ = 0;
+    second_started_at_ = now;
+  }
+}
+
+void Telemetry::Reset() {
+  // the follower addresses stay, they're set once at startup
+  auto addresses = followers;
+  *this = Telemetry{};
+  for (size_t i = 0; i < followers.size(); i++) {
+    followers[i].address = addresses[i].address;
+  }
+  second_started_at_ = millis();
+}
@@ -0,0 +1,210 @@
+/*
+ * 16n Faderbank MIDI thru
+ * MIT License
+ */
+#include "thru.hpp"
+
+#include <Arduino.h>
+#include <array>
+#include <span>
+#include "configuration.hpp"
+#include "presets.hpp"
+#include "telemetry.hpp"
+#include "trs.hpp"
+
+// the most SysEx the USB core hands over in one go, USB_MIDI_SYSEX_MAX in the Teensy core
+constexpr size_t usb_sysex_chunk = 290;
+
+// the TRS message being put together, a byte at a time. usbMIDI only sends SysEx whole, so this is as long as
+// SysEx from TRS can be.
+static std::array<uint8_t, 256> message;
+static size_t length = 0;
+static uint8_t running_status = 0;
+static bool overflowed = false;  // a SysEx message too long for the buffer, dropped when it ends
+
+// messages have gone to USB since the last flush
+static bool usb_pending = false;
+
+// a SysEx message from USB has started going to TRS, and its end hasn't
+static bool sysex_open = false;
+
+namespace thru {
+
+/*
+ * Passes a message that arrived over USB on to TRS, if the filter lets it through
+ */
+void FromUsb() {
+  const uint8_t type = usbMIDI.getType();
+  const uint8_t channel = usbMIDI.getChannel();
+
+  if (type == 0xC0) {
+    presets::ProgramChange(channel, usbMIDI.getData1());
+  }
+
+  // SysEx has already gone through ForwardSysEx(), by now the array only holds its last chunk
+  if (type == 0xF0 || !(config.thru_usb_to_trs & KindOf(type))) {
+    return;
+  }
+
+  if (type >= 0xF8) {
+    trs::ForwardRealTime(type);
+  }
+  else {
+    // any other status byte would end a SysEx message on TRS anyway
+    EndSysEx();
+
+    const uint8_t status = type < 0xF0 ? type | ((channel - 1) & 0x0F) : type;
+    const std::array<uint8_t, 3> bytes = {status, usbMIDI.getData1(), usbMIDI.getData2()};
+    trs::Forward(std::span{bytes}.first(MessageLength(status)));
+  }
+}
+
+void ForwardSysEx(std::span<const uint8_t> piece) {
+  if (!(config.thru_usb_to_trs & SYSEX) || piece.empty()) {
+    return;
+  }
+
+  // the rest of a message that was dropped, or never started, goes nowhere
+  if (piece.front() == 0xF0) {
+    EndSysEx();
+  }
+  else if (!sysex_open) {
+    return;
+  }
+
+  // a byte is kept back for the end of a message cut short
+  if (piece.size() + 1 > trs::Room()) {
+    telemetry.thru_dropped++;
+    EndSysEx();
+    return;
+  }
+
+  trs::Forward(piece);
+  sysex_open = piece.back() != 0xF7;
+}
+
+void EndSysEx() {
+  if (sysex_open) {
+    const uint8_t end = 0xF7;
+    trs::Forward({&end, 1});
+    sysex_open = false;
+  }
+}
+
+/*
+ * Acts on a complete message from TRS, and passes it on to USB if the filter lets it through
+ */
+void FromTrs() {
+  const uint8_t status = message[0];
+  const uint8_t data1 = length > 1 ? message[1] : 0;
+  const uint8_t data2 = length > 2 ? message[2] : 0;
+  const uint8_t channel = (status & 0x0F) + 1;
+
+  if ((status & 0xF0) == 0xC0) {
+    presets::ProgramChange(channel, data1);
+  }
+
+  if (!(config.thru_trs_to_usb & KindOf(status))) {
+    return;
+  }
+
+  if (status == 0xF0) {
+    usbMIDI.sendSysEx(length, message.data(), true);
+  }
+  else if (status < 0xF0) {
+    usbMIDI.send(status & 0xF0, data1, data2, channel, 0);
+  }
+  else {
+    usbMIDI.send(status, data1, data2, 0, 0);
+  }
+  usb_pending = true;
+}
+
+/*
+ * Puts a byte from TRS into the message being put together, acting on the message once it's complete
+ */
+void Parse(uint8_t byte) {
+  // real time can arrive between any two bytes, even in the middle of a message
+  if (byte >= 0xF8) {
+    if (config.thru_trs_to_usb & KindOf(byte)) {
+      usbMIDI.sendRealTime(byte);
+      usb_pending = true;
+    }
+    return;
+  }
+
+  const bool in_sysex = length && message[0] == 0xF0;
+
+  if (byte == 0xF7 && in_sysex) {
+    if (!overflowed && length < message.size()) {
+      message[length++] = byte;
+      FromTrs();
+    }
+    else if (config.thru_trs_to_usb & SYSEX) {
+      telemetry.thru_dropped++;
+    }
+    length = 0;
+    overflowed = false;
+    return;
+  }
+
+  // an end of SysEx with no start is nothing
+  if (byte == 0xF7) {
+    length = 0;
+    return;
+  }
+
+  // any other status byte starts a new message, abandoning an unfinished one
+  if (byte & 0x80) {
+    message[0] = byte;
+    length = 1;
+    overflowed = false;
+    running_status = byte < 0xF0 ? byte : 0;
+  }
+  else if (in_sysex) {
+    if (length < message.size()) {
+      message[length++] = byte;
+    }
+    else {
+      overflowed = true;
+    }
+    return;
+  }
+  else if (length) {
+    message[length++] = byte;
+  }
+  else if (running_status) {
+    // a data byte with no status in front of it uses the last one
+    message[0] = running_status;
+    message[1] = byte;
+    length = 2;
+  }
+  else {
+    return;  // nothing to attach it to
+  }
+
+  if (length == MessageLength(message[0])) {
+    FromTrs();
+    length = 0;
+  }
+}
+
+void Read() {
+  // USB arrives a message at a time, already framed. It's left waiting while TRS couldn't take a whole chunk
+  // of SysEx, so long messages go through at the pace of TRS rather than being cut short.
+  while (trs::Room() > usb_sysex_chunk && usbMIDI.read()) {
+    FromUsb();
+  }
+
+  // TRS arrives a byte at a time
+  while (Serial1.available() > 0) {
+    Parse(Serial1.read());
+  }
+
+  // thru shouldn't wait on the USB stack's own schedule, a late clock is a wrong clock
+  if (usb_pending) {
+    usbMIDI.send_now();
+    usb_pending = false;
+  }
+}
+}  // namespace thru
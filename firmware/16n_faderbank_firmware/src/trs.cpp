@@ -0,0 +1,220 @@
+/*
+ * 16n Faderbank TRS MIDI output scheduling
+ * MIT License
+ */
+#include "trs.hpp"
+
+#include <Arduino.h>
+#include <array>
+#include <bitset>
+#include "configuration.hpp"
+#include "midi.hpp"
+#include "telemetry.hpp"
+#include "thru.hpp"
+
+// the latest value waiting to go out for each destination
+static std::array<int, Config::NUM_DESTINATIONS> pending_values;
+static std::bitset<Config::NUM_DESTINATIONS> pending;  // the destinations with a value waiting
+static size_t next_destination = 0;                     // where the round robin picks up
+static bool stalled = false;  // the last message waiting found no room, and hasn't gone yet
+
+// thru messages waiting to go out: whole ones, and SysEx as it arrives
+static std::array<uint8_t, 512> thru_queue;
+static size_t thru_head = 0;  // the next byte to send
+static size_t thru_size = 0;
+static bool in_sysex = false;  // part of a SysEx message has gone out, nothing else can until the rest has
+static bool faders_turn = false;  // a thru message went last, a fader value goes before the next one
+
+// thru real time bytes waiting to go out
+static std::array<uint8_t, 16> realtime_queue;
+static size_t realtime_head = 0;
+static size_t realtime_size = 0;
+
+// the status byte the receiver will assume for a message that starts without one
+static uint8_t running_status = 0;
+
+/*
+ * Writes a channel message to Serial1, leaving out the status byte when the last one still applies
+ */
+static void Send(uint8_t status, uint8_t data1, uint8_t data2, size_t length) {
+  if (status != running_status) {
+    Serial1.write(status);
+  }
+  Serial1.write(data1);
+  if (length > 2) {
+    Serial1.write(data2);
+  }
+  running_status = status;
+}
+
+/// Writes controller messages for MIDI::SendControl
+struct Port {
+  void sendControlChange(uint8_t control, uint8_t value, uint8_t channel) {
+    Send(0xB0 | ((channel - 1) & 0x0F), control, value, 3);
+  }
+};
+
+static uint8_t Peek(size_t offset) {
+  return thru_queue[(thru_head + offset) % thru_queue.size()];
+}
+
+static void Pop(size_t count) {
+  thru_head = (thru_head + count) % thru_queue.size();
+  thru_size -= count;
+  stalled = false;
+}
+
+/*
+ * Sends as much of a SysEx message as fits, returning whether it has all gone
+ */
+static bool SendSysEx() {
+  while (thru_size && Serial1.availableForWrite() > 0) {
+    const uint8_t byte = Peek(0);
+    Serial1.write(byte);
+    Pop(1);
+    if (byte == 0xF7) {
+      in_sysex = false;
+      return true;
+    }
+  }
+  return false;
+}
+
+/*
+ * Sends the next thru message if it fits whole, or as much of a SysEx message as fits.
+ * Returns whether a message finished going out.
+ */
+static bool SendThruMessage() {
+  if (in_sysex) {
+    return SendSysEx();
+  }
+  if (!thru_size) {
+    return false;
+  }
+
+  const uint8_t status = Peek(0);
+
+  // SysEx can be longer than the UART buffer, so it goes in pieces
+  if (status == 0xF0) {
+    in_sysex = true;
+    running_status = 0;
+    return SendSysEx();
+  }
+
+  const size_t length = thru::MessageLength(status);
+  if (Serial1.availableForWrite() < static_cast<int>(length)) {
+    return false;
+  }
+
+  if (status < 0xF0) {
+    Send(status, Peek(1), length > 2 ? Peek(2) : 0, length);
+  }
+  else {
+    // system common messages cancel running status
+    for (size_t i = 0; i < length; i++) {
+      Serial1.write(Peek(i));
+    }
+    running_status = 0;
+  }
+  Pop(length);
+  return true;
+}
+
+/*
+ * Sends the next waiting fader value, round robin, if it fits whole. Returns whether one went.
+ */
+static bool SendFader() {
+  if (!pending.any()) {
+    return false;
+  }
+
+  // find the next waiting destination, starting after the last one sent
+  size_t d = next_destination;
+  while (!pending.test(d)) {
+    d = (d + 1) % pending.size();
+  }
+
+  // only start a message the UART buffer can take whole, so we never block on it
+  const Config::Destination& trs = config.destination(d);
+  if (Serial1.availableForWrite() < MIDI::MessageSize(trs.resolution)) {
+    return false;
+  }
+
+  Port port;
+  MIDI::SendControl(port, trs.resolution, trs.number, pending_values[d], trs.channel);
+  pending.reset(d);
+  stalled = false;
+  telemetry.trs_messages++;
+  next_destination = (d + 1) % pending.size();
+  return true;
+}
+
+namespace trs {
+
+void Start() {
+  Serial1.begin(31250);
+}
+
+void Queue(size_t destination, int value) {
+  telemetry.trs_coalesced += pending.test(destination);
+  pending_values[destination] = value;
+  pending.set(destination);
+}
+
+size_t Room() {
+  return thru_queue.size() - thru_size;
+}
+
+void Forward(std::span<const uint8_t> message) {
+  if (message.empty()) {
+    return;
+  }
+  if (message.size() > Room()) {
+    telemetry.thru_dropped++;
+    return;
+  }
+
+  for (uint8_t byte : message) {
+    thru_queue[(thru_head + thru_size++) % thru_queue.size()] = byte;
+  }
+}
+
+void ForwardRealTime(uint8_t type) {
+  if (realtime_size < realtime_queue.size()) {
+    realtime_queue[(realtime_head + realtime_size++) % realtime_queue.size()] = type;
+  }
+}
+
+void Service() {
+  // real time goes between any two bytes, so it never waits behind a message
+  while (realtime_size && Serial1.availableForWrite() > 0) {
+    Serial1.write(realtime_queue[realtime_head]);
+    realtime_head = (realtime_head + 1) % realtime_queue.size();
+    realtime_size--;
+  }
+
+  // then thru messages and fader values take turns, a whole message at a time, so a busy thru stream can't
+  // keep the faders waiting. Whichever's turn it is waits for room rather than letting the other jump in.
+  // Only SysEx, which nothing but real time may break into, holds the faders up until it ends.
+  for (;;) {
+    if (faders_turn && !in_sysex && pending.any()) {
+      if (!SendFader()) {
+        break;
+      }
+      faders_turn = false;
+    }
+    else if (SendThruMessage()) {
+      faders_turn = true;
+    }
+    else if (in_sysex || thru_size || !SendFader()) {
+      break;
+    }
+  }
+
+  // whatever is left had no room, except the faders behind a SysEx message whose rest hasn't arrived yet
+  if (thru_size || (pending.any() && !in_sysex)) {
+    telemetry.trs_stalls += !stalled;
+    stalled = true;
+  }
+}
+}  // namespace trs
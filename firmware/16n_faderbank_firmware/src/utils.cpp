@@ -5,15 +5,6 @@
  */
 #include "utils.hpp"
 
-namespace eeprom {
-
-void write(std::span<uint8_t> buffer, int offset) {
-  for (size_t i = 0; i < buffer.size(); i++) {
-    EEPROM.write(offset + i, buffer[i]);
-  }
-}
-}  // namespace eeprom
-
 namespace debug {
 void printHex(uint8_t num) {
   if constexpr (!DEBUG) {